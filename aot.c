@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include "aot.h"
+
+
+/* The runtime side of -A. The library's tables are looked up by name
+   rather than linked, since the simulator is built without them. A jump
+   into the middle of a block, out of the image or to a computed target
+   that starts no block is run by the interpreter, one instruction at a
+   time, until it reaches a block again. Code is translated once, so
+   the image's pages are hooked and the first store into it ends the run
+   with an error rather than leave the blocks running stale code */
+
+static Address base;
+static Word words;
+static const AotBlock *blocks;
+
+
+static const void *symbol(void *library, const char *name, const char *filename) {
+  const void *address = dlsym(library, name);
+  if (address == NULL) {
+    fprintf(stderr, "%s: no %s, not made by tools/rvaot?\n", filename, name);
+    exit(-1);
+  }
+  return address;
+}
+
+
+void aot_init(const char *filename, Byte *memory) {
+  void *library = dlopen(filename, RTLD_NOW);
+  const Word *image;
+  Address page;
+
+  if (library == NULL) {
+    fprintf(stderr, "%s\n", dlerror());
+    exit(-1);
+  }
+  base = *(const Address *) symbol(library, "aot_base", filename);
+  words = *(const Word *) symbol(library, "aot_words", filename);
+  blocks = symbol(library, "aot_blocks", filename);
+  image = symbol(library, "aot_image", filename);
+
+  if (*(const Word *) symbol(library, "aot_op_count", filename) != OP_COUNT) {
+    fprintf(stderr, "%s: translated for a simulator with other instructions\n", filename);
+    exit(-1);
+  }
+  if (base + 4 * words > MEMORY_SPACE || memcmp(memory + base, image, 4 * words) != 0) {
+    fprintf(stderr, "%s: translated from another program\n", filename);
+    exit(-1);
+  }
+  for (page = base >> PAGE_SHIFT; page < (base + 4 * words + PAGE_SIZE - 1) >> PAGE_SHIFT; page++) {
+    page_hooks[page] |= PAGE_HOOK_AOT;
+  }
+}
+
+
+void aot_store(Address address, Alignment alignment) {
+  if (address + alignment <= base || address >= base + 4 * words) return;
+  fprintf(stderr, "store to %08x overwrites code translated by -A, which cannot run code that changes\n", address);
+  exit(-1);
+}
+
+
+static AotBlock find(Address pc) {
+  Word slot = (pc - base) >> 1;
+  return (pc & 1) == 0 && slot < 2 * words ? blocks[slot] : NULL;
+}
+
+
+void aot_execute(Processor *processor, Byte *memory) {
+  AotBlock block = find(processor->PC);
+  if (block) block(processor, memory);
+  else interpret(processor, memory);
+}
+
+
+void aot_run(Processor *processor, Byte *memory) {
+  AotNext next = { NULL };
+  while (1) {
+    if (next.block == NULL && (next.block = find(processor->PC)) == NULL) {
+      interpret(processor, memory);
+      continue;
+    }
+    next = next.block(processor, memory);
+  }
+}
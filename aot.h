@@ -0,0 +1,48 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include "types.h"
+#include "riscv.h"
+#include "utils.h"
+
+/* Ahead-of-time translated images. tools/rvaot turns a program into C
+   with one function per basic block, which is built as a shared object
+   and loaded with -A. Blocks run on the simulator's own load(), store()
+   and execute_decoded(), so memory, ecalls and faults behave as they
+   always do */
+
+/* What a block says to run next: the block at a target it knows, or
+   NULL to look the PC up */
+typedef struct AotNext AotNext;
+struct AotNext {
+  AotNext (*block)(Processor *, Byte *memory);
+};
+
+typedef AotNext (*AotBlock)(Processor *, Byte *memory);
+
+/* What the generated code defines. aot_blocks has an entry for every
+   halfword of the aot_words words of the image, NULL unless a block
+   starts there. aot_image is the image itself, checked against memory
+   before anything runs */
+extern const Address aot_base;
+extern const Word aot_words;
+extern const Word aot_op_count;
+extern const AotBlock aot_blocks[];
+extern const Word aot_image[];
+
+/* Loads the translation in library and checks it was made from the
+   program in memory, by this build of the simulator */
+void aot_init(const char *library, Byte *memory);
+
+/* Stops the run if a store of alignment bytes at address lands in the
+   translated image, whose blocks would go on running the old code */
+void aot_store(Address address, Alignment alignment);
+
+/* An Engine: runs the block at the PC, or one instruction if no block
+   starts there */
+void aot_execute(Processor *, Byte *memory);
+
+/* Runs from block to block until the program ends. Does not return */
+void aot_run(Processor *, Byte *memory);
+
+#endif
@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bbv.h"
+#include "riscv.h"
+
+
+/* A block here is a run of instructions entered at its first one and
+   left by anything but falling through to the next, so one per
+   execute() that does not go to the next instruction. Blocks are kept
+   by the halfword they start at. Intervals are exactly interval
+   instructions long, a block that straddles two counting in both, so
+   that interval n starts when instret reaches n * interval */
+
+Word bbv_interval;
+Address bbv_block;
+Word bbv_length;
+
+static FILE *out;
+static Word *ids, next_id = 1;
+static Double *counts, executed;
+
+/* Where the blocks run in this interval start */
+static Word *touched, touched_count;
+
+
+static void write_vector(void) {
+  Word i, slot;
+  if (touched_count == 0) return;
+  fputc('T', out);
+  for (i = 0; i < touched_count; i++) {
+    slot = touched[i];
+    if (ids[slot] == 0) ids[slot] = next_id++;
+    fprintf(out, ":%u:%llu ", ids[slot], (unsigned long long) counts[slot]);
+    counts[slot] = 0;
+  }
+  fputc('\n', out);
+  touched_count = 0;
+  executed = 0;
+}
+
+
+static void count(Word slot, Word length) {
+  if (counts[slot] == 0) touched[touched_count++] = slot;
+  counts[slot] += length;
+  executed += length;
+}
+
+
+void bbv_end_block(Address next) {
+  Word slot = (bbv_block >> 1) % (MEMORY_SPACE / 2), part;
+  while (executed + bbv_length >= bbv_interval) {
+    part = bbv_interval - executed;
+    count(slot, part);
+    bbv_length -= part;
+    write_vector();
+  }
+  if (bbv_length) count(slot, bbv_length);
+  bbv_length = 0;
+  bbv_block = next;
+}
+
+
+/* The last interval, however short */
+static void finish(void) {
+  if (bbv_length) bbv_end_block(bbv_block);
+  write_vector();
+  fclose(out);
+}
+
+
+void bbv_init(Word interval, Address entry, const char *filename) {
+  if ((out = fopen(filename, "w")) == NULL) {
+    perror(filename);
+    exit(-1);
+  }
+  ids = calloc(MEMORY_SPACE / 2, sizeof(Word));
+  counts = calloc(MEMORY_SPACE / 2, sizeof(Double));
+  touched = malloc(MEMORY_SPACE / 2 * sizeof(Word));
+  bbv_block = entry;
+  bbv_interval = interval;
+  atexit(finish);
+}
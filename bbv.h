@@ -0,0 +1,29 @@
+#ifndef BBV_H
+#define BBV_H
+
+#include "types.h"
+
+/* Instructions per interval unless -n says otherwise */
+#define BBV_DEFAULT_INTERVAL 1000000
+
+/* Basic-block vectors, one per interval of retired instructions, in the
+   SimPoint .bb format: a line "T:id:count :id:count ..." per interval,
+   where count is the instructions run in block id. Blocks are numbered
+   from 1 in the order they first ran. tools/rvsimpoint clusters them */
+extern Word bbv_interval;
+extern Address bbv_block;
+extern Word bbv_length;
+
+/* Starts collecting from the block at entry, writing to filename */
+void bbv_init(Word interval, Address entry, const char *filename);
+
+void bbv_end_block(Address next);
+
+/* For the execute loop: next is the PC after the length bytes of
+   instruction at pc ran */
+static inline void bbv_hit(Address pc, Address next, Word length) {
+  bbv_length++;
+  if (next != pc + length) bbv_end_block(next);
+}
+
+#endif
@@ -0,0 +1,52 @@
+#include <pthread.h>
+#include "bus.h"
+#include "utils.h"
+
+
+/* Memory-mapped devices. RAM is everything below MEMORY_SPACE, and
+   load() and store() only come here for addresses above it, so RAM keeps
+   its single compare. Devices are few and each access takes the lock,
+   which keeps harts on separate threads from interleaving inside a
+   device model */
+
+static const Device *devices[BUS_MAX_DEVICES];
+static int device_count;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+void bus_attach(const Device *device) {
+  if (device_count < BUS_MAX_DEVICES) devices[device_count++] = device;
+}
+
+
+static const Device *find(Address address, Alignment alignment) {
+  int i;
+  for (i = 0; i < device_count; i++) {
+    if (address - devices[i]->base < devices[i]->size && address + alignment - devices[i]->base <= devices[i]->size) {
+      return devices[i];
+    }
+  }
+  return NULL;
+}
+
+
+Word bus_load(Byte *memory, Address address, Alignment alignment) {
+  const Device *device = find(address, alignment);
+  Word value;
+
+  if (device == NULL || device->load == NULL) handle_invalid_read(address);
+  pthread_mutex_lock(&lock);
+  value = device->load(memory, address - device->base, alignment);
+  pthread_mutex_unlock(&lock);
+  return value;
+}
+
+
+void bus_store(Byte *memory, Address address, Alignment alignment, Word value) {
+  const Device *device = find(address, alignment);
+
+  if (device == NULL || device->store == NULL) handle_invalid_write(address);
+  pthread_mutex_lock(&lock);
+  device->store(memory, address - device->base, alignment, value);
+  pthread_mutex_unlock(&lock);
+}
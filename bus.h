@@ -0,0 +1,25 @@
+#ifndef BUS_H
+#define BUS_H
+
+#include "types.h"
+
+/* Most devices the bus can hold */
+#define BUS_MAX_DEVICES 8
+
+/* A device model answering loads and stores to size bytes at base. Its
+   handlers get the offset into that range */
+typedef struct {
+  const char *name;
+  Address base, size;
+  Word (*load)(Byte *memory, Address offset, Alignment);
+  void (*store)(Byte *memory, Address offset, Alignment, Word value);
+} Device;
+
+void bus_attach(const Device *);
+
+/* The slow paths of load() and store(), for addresses past RAM. An
+   address no device answers is an invalid access */
+Word bus_load(Byte *memory, Address address, Alignment);
+void bus_store(Byte *memory, Address address, Alignment, Word value);
+
+#endif
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <pthread.h>
+#include "console.h"
+#include "utils.h"
+
+
+/* Guest output to fd 1 is batched here and handed to stdout in one go.
+   Anything the host prints on stdout must call console_flush() first,
+   otherwise guest and host output come out of order. Harts on other
+   threads share the buffer under lock. */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static char buffer[CONSOLE_BUFFER_SIZE];
+static size_t used;
+static FlushPolicy policy = CONSOLE_FLUSH_ALWAYS;
+static int muted;
+static Double written;
+
+
+void console_init(FlushPolicy flush_policy) {
+  policy = flush_policy;
+  atexit(console_flush);
+}
+
+
+static void flush(void) {
+  if (used) {
+    fwrite(buffer, 1, used, stdout);
+    used = 0;
+  }
+}
+
+
+void console_flush(void) {
+  pthread_mutex_lock(&lock);
+  flush();
+  pthread_mutex_unlock(&lock);
+}
+
+
+static void append(const void *data, size_t len) {
+  if (len > sizeof(buffer) - used) {
+    flush();
+    // too big to be worth batching
+    if (len >= sizeof(buffer)) {
+      fwrite(data, 1, len, stdout);
+      return;
+    }
+  }
+  memcpy(buffer + used, data, len);
+  used += len;
+}
+
+
+/* Bytes of guest output so far, for stats.c */
+Double console_bytes(void) {
+  return written;
+}
+
+
+/* Drops guest output while set, e.g. while replay re-executes code whose
+   output was already shown */
+void console_mute(int mute) {
+  muted = mute;
+}
+
+
+/* Writes len bytes of guest memory to a guest file descriptor.
+   Returns the number of bytes written, or -1 for an unknown fd */
+sWord console_write(Word fd, const Byte *buf, Word len) {
+  if (muted) return fd == 1 || fd == 2 ? (sWord) len : -1;
+  switch (fd) {
+    case 1:
+      pthread_mutex_lock(&lock);
+      written += len;
+      append(buf, len);
+      if (policy == CONSOLE_FLUSH_ALWAYS
+          || (policy == CONSOLE_FLUSH_LINE && memchr(buf, '\n', len) != NULL)) {
+        flush();
+      }
+      pthread_mutex_unlock(&lock);
+      return len;
+    case 2:
+      // stderr stays unbuffered, but must not overtake earlier stdout output
+      pthread_mutex_lock(&lock);
+      written += len;
+      flush();
+      fflush(stdout);
+      fwrite(buf, 1, len, stderr);
+      pthread_mutex_unlock(&lock);
+      return len;
+    default:
+      return -1;
+  }
+}
+
+
+void console_print_int(sWord value) {
+  char digits[16];
+  size_t length;
+  if (muted) return;
+  length = format_int(digits, value) - digits;
+  pthread_mutex_lock(&lock);
+  written += length;
+  append(digits, length);
+  if (policy == CONSOLE_FLUSH_ALWAYS) flush();
+  pthread_mutex_unlock(&lock);
+}
+
+
+/* What the simulator says about the guest, e.g. that it exited or made a
+   bad access. In order with guest output, and muted along with it */
+void console_report(const char *format, ...) {
+  va_list args;
+  if (muted) return;
+  pthread_mutex_lock(&lock);
+  flush();
+  va_start(args, format);
+  vprintf(format, args);
+  va_end(args);
+  pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,25 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <stddef.h>
+#include "types.h"
+
+/* Size of the host-side buffer that batches guest console output */
+#define CONSOLE_BUFFER_SIZE (64 * 1024)
+
+/* When buffered guest output is handed to the host */
+typedef enum {
+  CONSOLE_FLUSH_FULL,   /* when the buffer fills up, and on exit */
+  CONSOLE_FLUSH_LINE,   /* also after every write containing a newline */
+  CONSOLE_FLUSH_ALWAYS, /* after every write, for when the host prints too */
+} FlushPolicy;
+
+void console_init(FlushPolicy);
+sWord console_write(Word fd, const Byte *buf, Word len);
+void console_print_int(sWord);
+Double console_bytes(void);
+void console_flush(void);
+void console_mute(int);
+void console_report(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+#endif
@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include "cosim.h"
+#include "console.h"
+#include "utils.h"
+
+
+/* Differential co-simulation. The reference interpreter and the engine
+   under test each get their own copy of the hart and of memory, and run
+   one step at a time. A step of the engine may retire more than one
+   instruction, see predecode.c, and the reference then runs as many.
+   After every step they must agree on the PC and registers, on which
+   bytes were stored (logged through PAGE_HOOK_COSIM) and what those
+   bytes hold, and on whether and how the program ended. Only the
+   reference's console output is shown */
+
+typedef struct {
+  Address address;
+  Alignment alignment;
+} Store;
+
+/* A step's stores. A step of -A is a whole block, so the log grows to
+   hold however many it makes */
+typedef struct {
+  Store *stores;
+  int count, capacity;
+  int halted, status;
+} Step;
+
+static Step *current;
+static jmp_buf halted;
+static const char *engine_name;
+
+
+void cosim_store(Address address, Alignment alignment) {
+  if (current->count == current->capacity) {
+    current->capacity = current->capacity ? 2 * current->capacity : COSIM_STORES;
+    current->stores = realloc(current->stores, current->capacity * sizeof(Store));
+  }
+  current->stores[current->count].address = address;
+  current->stores[current->count].alignment = alignment;
+  current->count++;
+}
+
+
+static void end_step(int status) {
+  current->halted = 1;
+  current->status = status;
+  longjmp(halted, 1);
+}
+
+
+/* Runs one step of the engine, adding to what record holds */
+static void step(Engine engine, Processor *processor, Byte *memory, Step *record) {
+  current = record;
+  if (setjmp(halted) == 0) engine(processor, memory);
+}
+
+
+/* Reports the divergence with the instructions leading up to it, the
+   last of which made it, and stops */
+static void diverged(Byte *memory, Address *history, Double count, const char *format, ...) {
+  char line[DISASM_MAX_LINE];
+  Instruction instruction;
+  Double i;
+  va_list args;
+
+  console_flush();
+  fflush(stdout);
+  fprintf(stderr, "%s diverged from the reference after %llu instructions: ", engine_name, (unsigned long long) count);
+  va_start(args, format);
+  vfprintf(stderr, format, args);
+  va_end(args);
+  fputc('\n', stderr);
+
+  for (i = count > COSIM_CONTEXT ? count - COSIM_CONTEXT : 0; i < count; i++) {
+    Address pc = history[i % COSIM_CONTEXT];
+    instruction.bits = 0;
+    if (pc < MEMORY_SPACE - 3) memcpy(&instruction.bits, memory + pc, 4);
+    fprintf(stderr, "%c %08x: %.*s", i == count - 1 ? '>' : ' ', pc,
+            (int) (disassemble(line, instruction) - line), line);
+  }
+  exit(-1);
+}
+
+
+static void compare(Processor *reference, Byte *memory, Step *expected,
+                    Processor *processor, Byte *engine_memory, Step *actual,
+                    Address *history, Double count) {
+  Address address;
+  int i;
+
+  if (expected->halted != actual->halted || (expected->halted && expected->status != actual->status)) {
+    diverged(memory, history, count, "reference %s, %s %s",
+             expected->halted ? "exited" : "went on", engine_name, actual->halted ? "exited" : "went on");
+  }
+  if (expected->halted) return;
+
+  if (reference->PC != processor->PC) {
+    diverged(memory, history, count, "pc %08x, %s has %08x", reference->PC, engine_name, processor->PC);
+  }
+  for (i = 1; i < 32; i++) {
+    if (reference->R[i] != processor->R[i]) {
+      diverged(memory, history, count, "x%d %08x, %s has %08x", i, reference->R[i], engine_name, processor->R[i]);
+    }
+  }
+
+  if (expected->count != actual->count) {
+    diverged(memory, history, count, "%d stores, %s made %d", expected->count, engine_name, actual->count);
+  }
+  for (i = 0; i < expected->count; i++) {
+    address = expected->stores[i].address;
+    if (address != actual->stores[i].address || expected->stores[i].alignment != actual->stores[i].alignment) {
+      diverged(memory, history, count, "%d-byte store to %08x, %s stored %d bytes at %08x",
+               expected->stores[i].alignment, address, engine_name,
+               actual->stores[i].alignment, actual->stores[i].address);
+    }
+    if (memcmp(memory + address, engine_memory + address, expected->stores[i].alignment) != 0) {
+      diverged(memory, history, count, "stored different values at %08x", address);
+    }
+  }
+}
+
+
+void cosim_run(Processor *reference, Byte *memory, Engine engine, const char *name, int print) {
+  Processor processor = *reference;
+  Byte *engine_memory = malloc(MEMORY_SPACE);
+  Address history[COSIM_CONTEXT], page, address;
+  Step expected = { NULL }, actual = { NULL };
+  Double count = 0, retired;
+
+  memcpy(engine_memory, memory, MEMORY_SPACE);
+  for (page = 0; page < PAGE_COUNT; page++) page_hooks[page] |= PAGE_HOOK_COSIM;
+  engine_name = name;
+  halt_hook = end_step;
+
+  while (1) {
+    expected.count = expected.halted = 0;
+    actual.count = actual.halted = 0;
+    retired = processor.counters.instret;
+    console_mute(1);
+    step(engine, &processor, engine_memory, &actual);
+    console_mute(0);
+
+    // what the engine retired, and the instruction that ended the run
+    retired = processor.counters.instret - retired + actual.halted;
+    do {
+      history[count++ % COSIM_CONTEXT] = reference->PC;
+      step(interpret, reference, memory, &expected);
+      if (print && !expected.halted) print_registers(reference);
+    } while (!expected.halted && retired-- > 1);
+
+    compare(reference, memory, &expected, &processor, engine_memory, &actual, history, count);
+
+    if (expected.halted) {
+      // stores are checked as they happen, this catches anything else
+      if (memcmp(memory, engine_memory, MEMORY_SPACE) != 0) {
+        for (address = 0; memory[address] == engine_memory[address]; address++);
+        diverged(memory, history, count, "memory at %08x differs at exit", address);
+      }
+      halt_hook = NULL;
+      halt_simulation(expected.status);
+    }
+  }
+}
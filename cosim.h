@@ -0,0 +1,19 @@
+#ifndef COSIM_H
+#define COSIM_H
+
+#include "riscv.h"
+
+/* Instructions shown before a divergence */
+#define COSIM_CONTEXT 8
+
+/* Stores logged for a step before the log has to grow */
+#define COSIM_STORES 16
+
+/* Runs engine in lockstep with interpret() from the state in processor
+   and memory, stopping at the first instruction after which their PCs,
+   registers, stores or exits differ. Does not return */
+void cosim_run(Processor *, Byte *memory, Engine engine, const char *name, int print);
+
+void cosim_store(Address address, Alignment alignment);
+
+#endif
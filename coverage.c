@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "coverage.h"
+#include "riscv.h"
+#include "utils.h"
+#include "console.h"
+
+
+/* Coverage of the loaded image, for auditing tests and for guiding the
+   fuzzer. The execute loop only bumps one counter per instruction, see
+   coverage_hit(). Harts on separate threads may lose the odd count to a
+   race, but never turn a covered instruction into an uncovered one */
+
+Double *coverage_counts;
+Address coverage_base;
+Word coverage_slots;
+__thread Address coverage_running;
+
+static Byte *image;
+static const char *listing;
+
+
+/* One line per instruction: how often it ran, its disassembly, and for
+   branches which ways they went. Those that never ran show as #####,
+   as in gcov */
+static void write_listing(void) {
+  FILE *file;
+  char line[DISASM_MAX_LINE];
+  char *end;
+  Instruction instruction;
+  Decoded decoded;
+  Double run, taken, fallthrough;
+  Word slot, instructions = 0, instructions_run = 0, directions = 0, directions_taken = 0;
+
+  if (strcmp(listing, "-") == 0) {
+    console_flush();
+    file = stdout;
+  } else if ((file = fopen(listing, "w")) == NULL) {
+    perror(listing);
+    return;
+  }
+
+  // the instruction that ended the run, which went nowhere
+  if (coverage_running) {
+    slot = (coverage_running - coverage_base) >> 1;
+    coverage_counts[2 * (slot < coverage_slots ? slot : coverage_slots)]++;
+  }
+
+  // in the order the -d listing has them, one halfword or two at a time
+  for (slot = 0; slot < coverage_slots; slot += decoded.length / 2) {
+    Address pc = coverage_base + 2 * slot;
+    memcpy(&instruction.bits, image + 2 * slot, 4);
+    decode(instruction, &decoded);
+    instructions++;
+    end = disassemble_decoded(line, &decoded) - 1;
+
+    fallthrough = coverage_counts[2 * slot];
+    taken = coverage_counts[2 * slot + 1];
+    run = fallthrough + taken;
+    instructions_run += run != 0;
+
+    if (run) fprintf(file, "%10llu  %08x: %.*s", (unsigned long long) run, pc, (int) (end - line), line);
+    else fprintf(file, "     #####  %08x: %.*s", pc, (int) (end - line), line);
+    if (instruction_specs[decoded.op].format == FORMAT_B) {
+      directions += 2;
+      directions_taken += (taken != 0) + (fallthrough != 0);
+      fprintf(file, "\ttaken %llu, not taken %llu", (unsigned long long) taken, (unsigned long long) fallthrough);
+    }
+    fputc('\n', file);
+  }
+  fprintf(file, "%u of %u instructions run, %u of %u branch directions taken\n",
+          instructions_run, instructions, directions_taken, directions);
+  if (file != stdout) fclose(file);
+}
+
+
+void coverage_init(Address base, Word size, Byte *memory, const char *filename) {
+  coverage_base = base;
+  coverage_slots = size / 2;
+  coverage_counts = calloc(2 * (coverage_slots + 1), sizeof(Double));
+  if (filename == NULL) return;
+
+  // as loaded, in case the program writes over itself
+  image = calloc(size + 2, 1);
+  memcpy(image, memory + base, size);
+  listing = filename;
+  atexit(write_listing);
+}
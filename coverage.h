@@ -0,0 +1,38 @@
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include <stddef.h>
+#include "types.h"
+
+/* Two counters per halfword of the loaded image, where an instruction
+   can start: how often the instruction there went on to the next one,
+   and how often it went anywhere else. For a branch those are not taken
+   and taken. One more pair at the end soaks up PCs outside the image */
+extern Double *coverage_counts;
+extern Address coverage_base;
+extern Word coverage_slots;
+
+/* Starts counting for the size bytes at base. The listing goes to
+   filename, if there is one, when the simulator exits */
+void coverage_init(Address base, Word size, Byte *memory, const char *filename);
+
+/* The instruction this thread is running, or 0 between instructions. One
+   that ends the run never gets back to coverage_hit(), so the listing
+   counts it from here */
+extern __thread Address coverage_running;
+
+/* For the execute loop, before the instruction at pc runs */
+static inline void coverage_start(Address pc) {
+  coverage_running = pc;
+}
+
+/* Branch-free, for the execute loop: next is the PC after the length
+   bytes of instruction at pc ran */
+static inline void coverage_hit(Address pc, Address next, Word length) {
+  Word slot = (pc - coverage_base) >> 1;
+  slot = slot < coverage_slots ? slot : coverage_slots;
+  coverage_counts[2 * slot + (next != pc + length)]++;
+  coverage_running = 0;
+}
+
+#endif
@@ -0,0 +1,137 @@
+#include <string.h>
+#include <time.h>
+#include "csr.h"
+#include "utils.h"
+#include "replay.h"
+
+
+/* The Zicsr registers: the user counters cycle, time and instret with
+   hpmcounter3-31, their machine-mode counterparts, which are writable,
+   the mhpmevent selectors and mhartid.
+
+   A cycle is one instruction here, so cycle and instret count the same
+   thing. The counters cost nothing unless read: see Counters in types.h */
+
+static Double host_time(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (Double) now.tv_sec * CSR_TIME_HZ + now.tv_nsec / (1000000000 / CSR_TIME_HZ);
+}
+
+
+/* The host clock is an input to the run, so it is logged for replay */
+Word csr_time(int high) {
+  Word value;
+  if (!replay_input(&value)) {
+    value = host_time() >> (high ? 32 : 0);
+    replay_record_input(value);
+  }
+  return value;
+}
+
+
+/* Both halves from one reading, logged as csr_time() logs them */
+Double csr_clock(void) {
+  Word low, high;
+  Double now;
+  if (!replay_input(&low) || !replay_input(&high)) {
+    now = host_time();
+    low = now;
+    high = now >> 32;
+    replay_record_input(low);
+    replay_record_input(high);
+  }
+  return (Double) high << 32 | low;
+}
+
+
+static Double counter_base(Counters *counters, Word n) {
+  if (n == 0 || n == 2) return counters->instret;
+  return counters->events[counters->event[n]];
+}
+
+
+static Double counter(Counters *counters, Word n) {
+  return counter_base(counters, n) + counters->offset[n];
+}
+
+
+static void set_counter(Counters *counters, Word n, Double value) {
+  counters->offset[n] = value - counter_base(counters, n);
+}
+
+
+int csr_read(Processor *processor, Word csr, Word *value) {
+  Counters *counters = &processor->counters;
+  Word n = csr & 0x1f;
+
+  if (csr == CSR_MHARTID) {
+    *value = processor->hartid;
+  } else if ((csr & ~0x1f) == CSR_COUNTER || (csr & ~0x1f) == CSR_COUNTERH) {
+    if (n == 1) *value = csr_time(csr & 0x80);
+    else *value = counter(counters, n) >> (csr & 0x80 ? 32 : 0);
+  } else if (((csr & ~0x1f) == CSR_MCOUNTER || (csr & ~0x1f) == CSR_MCOUNTERH) && n != 1) {
+    *value = counter(counters, n) >> (csr & 0x80 ? 32 : 0);
+  } else if ((csr & ~0x1f) == CSR_MHPMEVENT && n >= 3) {
+    *value = counters->event[n];
+  } else {
+    return 0;
+  }
+  return 1;
+}
+
+
+int csr_write(Processor *processor, Word csr, Word value) {
+  Counters *counters = &processor->counters;
+  Word n = csr & 0x1f;
+  Double old;
+
+  if ((csr & ~0x1f) == CSR_MCOUNTER && n != 1) {
+    set_counter(counters, n, (counter(counters, n) & ~(Double) 0xffffffff) | value);
+  } else if ((csr & ~0x1f) == CSR_MCOUNTERH && n != 1) {
+    set_counter(counters, n, (counter(counters, n) & 0xffffffff) | (Double) value << 32);
+  } else if ((csr & ~0x1f) == CSR_MHPMEVENT && n >= 3) {
+    // the counter carries on from where it was, counting the new event
+    old = counter(counters, n);
+    counters->event[n] = value < EVENT_COUNT ? value : EVENT_NONE;
+    set_counter(counters, n, old);
+  } else {
+    // everything else, mhartid and the user counters included, is read-only
+    return 0;
+  }
+  return 1;
+}
+
+
+static const char *counter_names[3] = { "cycle", "time", "instret" };
+
+
+char *format_csr(char *out, Word csr) {
+  Word n = csr & 0x1f;
+
+  if (csr == CSR_MHARTID) return format_str(out, "mhartid");
+
+  switch (csr & ~0x1f) {
+    case CSR_MCOUNTER:
+    case CSR_MCOUNTERH:
+      if (n == 1) break;
+      *out++ = 'm';
+      // fall through
+    case CSR_COUNTER:
+    case CSR_COUNTERH:
+      if (n < 3) {
+        out = format_str(out, counter_names[n]);
+      } else {
+        out = format_str(out, "hpmcounter");
+        out = format_int(out, n);
+      }
+      if (csr & 0x80) *out++ = 'h';
+      return out;
+    case CSR_MHPMEVENT:
+      if (n < 3) break;
+      out = format_str(out, "mhpmevent");
+      return format_int(out, n);
+  }
+  out = format_str(out, "0x");
+  return format_hex(out, csr, 3);
+}
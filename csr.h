@@ -0,0 +1,31 @@
+#ifndef CSR_H
+#define CSR_H
+
+#include "types.h"
+
+/* Rate of the time CSR: microseconds of host time */
+#define CSR_TIME_HZ 1000000
+
+#define CSR_MHPMEVENT 0x320
+#define CSR_MCOUNTER 0xB00
+#define CSR_MCOUNTERH 0xB80
+#define CSR_COUNTER 0xC00
+#define CSR_COUNTERH 0xC80
+#define CSR_MHARTID 0xF14
+
+/* Both return 0 when the hart cannot access csr that way */
+int csr_read(Processor *, Word csr, Word *value);
+int csr_write(Processor *, Word csr, Word value);
+
+/* Half of the time CSR, the high half if high is set. The MMIO timer
+   reads the same clock */
+Word csr_time(int high);
+
+/* The whole of the time CSR, read once, for a 64-bit comparison that a
+   carry between two csr_time() calls would throw off */
+Double csr_clock(void);
+
+/* Writes csr's name, or its number in hex when it has none */
+char *format_csr(char *out, Word csr);
+
+#endif
@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include "debug.h"
+#include "riscv.h"
+
+
+/* Breakpoints, watchpoints and register conditions for the interactive
+   mode. Between stops the simulator runs at full speed: a breakpoint is
+   one bit per halfword-aligned PC, a watchpoint only costs anything on
+   pages flagged PAGE_HOOK_WATCH, and conditions are only evaluated while
+   some are set */
+
+typedef struct {
+  Address start, end;
+} Watchpoint;
+
+typedef struct {
+  unsigned int reg;
+  Comparison comparison;
+  Word value;
+  int was_true;
+} Condition;
+
+static const char *comparison_names[] = { "==", "!=", "<", "<=", ">", ">=" };
+
+int debug_stepping = 1;
+int debug_stop;
+Word debug_breakpoints[MEMORY_SPACE / 2 / 32];
+int debug_condition_count;
+
+static Watchpoint watchpoints[DEBUG_MAX_WATCHPOINTS];
+static int watchpoint_count;
+static Condition conditions[DEBUG_MAX_CONDITIONS];
+
+/* what the last stop was about */
+static Address hit_address;
+static int hit_condition;
+
+
+int debug_add_breakpoint(Address pc) {
+  Address slot = pc >> 1;
+  if ((pc & 1) || slot >= MEMORY_SPACE / 2) return 0;
+  debug_breakpoints[slot >> 5] |= 1u << (slot & 31);
+  return 1;
+}
+
+
+int debug_remove_breakpoint(Address pc) {
+  Address slot = pc >> 1;
+  if (!debug_breakpoint_at(pc)) return 0;
+  debug_breakpoints[slot >> 5] &= ~(1u << (slot & 31));
+  return 1;
+}
+
+
+/* Recomputes which pages need stores to go through the hook */
+static void update_watched_pages(void) {
+  Address page;
+  int i;
+  for (page = 0; page < PAGE_COUNT; page++) page_hooks[page] &= ~PAGE_HOOK_WATCH;
+  for (i = 0; i < watchpoint_count; i++) {
+    for (page = watchpoints[i].start >> PAGE_SHIFT; page <= (watchpoints[i].end - 1) >> PAGE_SHIFT; page++) {
+      page_hooks[page] |= PAGE_HOOK_WATCH;
+    }
+  }
+}
+
+
+int debug_add_watchpoint(Address address, Word length) {
+  if (watchpoint_count == DEBUG_MAX_WATCHPOINTS || length == 0
+      || address >= MEMORY_SPACE || length > MEMORY_SPACE - address) {
+    return 0;
+  }
+  watchpoints[watchpoint_count].start = address;
+  watchpoints[watchpoint_count].end = address + length;
+  watchpoint_count++;
+  update_watched_pages();
+  return 1;
+}
+
+
+int debug_remove_watchpoint(Address address) {
+  int i, removed = 0;
+  for (i = 0; i < watchpoint_count; i++) {
+    if (watchpoints[i].start == address) {
+      watchpoints[i--] = watchpoints[--watchpoint_count];
+      removed = 1;
+    }
+  }
+  update_watched_pages();
+  return removed;
+}
+
+
+void debug_watch_store(Address address, Alignment alignment) {
+  int i;
+  for (i = 0; i < watchpoint_count; i++) {
+    if (address < watchpoints[i].end && address + alignment > watchpoints[i].start) {
+      debug_stop |= DEBUG_STOP_WATCHPOINT;
+      hit_address = address;
+      return;
+    }
+  }
+}
+
+
+static int holds(Condition *condition, Processor *processor) {
+  sWord reg = processor->R[condition->reg], value = condition->value;
+  switch (condition->comparison) {
+    case COND_EQ: return reg == value;
+    case COND_NE: return reg != value;
+    case COND_LT: return reg < value;
+    case COND_LE: return reg <= value;
+    case COND_GT: return reg > value;
+    default: return reg >= value;
+  }
+}
+
+
+int debug_add_condition(Processor *processor, unsigned int reg, Comparison comparison, Word value) {
+  if (debug_condition_count == DEBUG_MAX_CONDITIONS || reg >= 32) return 0;
+  conditions[debug_condition_count].reg = reg;
+  conditions[debug_condition_count].comparison = comparison;
+  conditions[debug_condition_count].value = value;
+  // one that already holds only stops once it has stopped holding
+  conditions[debug_condition_count].was_true = holds(&conditions[debug_condition_count], processor);
+  debug_condition_count++;
+  return 1;
+}
+
+
+void debug_clear_conditions(void) {
+  debug_condition_count = 0;
+}
+
+
+/* Conditions stop when they become true, not for as long as they are */
+void debug_check_conditions(Processor *processor) {
+  int i, now;
+  for (i = 0; i < debug_condition_count; i++) {
+    now = holds(&conditions[i], processor);
+    if (now && !conditions[i].was_true) {
+      debug_stop |= DEBUG_STOP_CONDITION;
+      hit_condition = i;
+    }
+    conditions[i].was_true = now;
+  }
+}
+
+
+/* The store that set off the last watchpoint stop */
+Address debug_watch_hit(void) {
+  return hit_address;
+}
+
+
+/* Says why the simulator stopped. pc is the last instruction executed */
+void debug_report(Address pc) {
+  if (debug_stop & DEBUG_STOP_WATCHPOINT) {
+    printf("watchpoint: store to %08x by the instruction at %08x\n", hit_address, pc);
+  }
+  if (debug_stop & DEBUG_STOP_CONDITION) {
+    Condition *c = &conditions[hit_condition];
+    printf("condition: x%d %s %d after the instruction at %08x\n",
+           c->reg, comparison_names[c->comparison], (sWord) c->value, pc);
+  }
+  debug_stop = 0;
+}
+
+
+void debug_list(void) {
+  Address slot;
+  int i;
+  for (slot = 0; slot < MEMORY_SPACE / 2; slot++) {
+    if (debug_breakpoints[slot >> 5] >> (slot & 31) & 1) printf("breakpoint %08x\n", slot << 1);
+  }
+  for (i = 0; i < watchpoint_count; i++) {
+    printf("watchpoint %08x-%08x\n", watchpoints[i].start, watchpoints[i].end - 1);
+  }
+  for (i = 0; i < debug_condition_count; i++) {
+    printf("condition x%d %s %d\n", conditions[i].reg, comparison_names[conditions[i].comparison], (sWord) conditions[i].value);
+  }
+}
@@ -0,0 +1,56 @@
+#ifndef DEBUG_H
+#define DEBUG_H
+
+#include "types.h"
+
+#define DEBUG_MAX_WATCHPOINTS 16
+#define DEBUG_MAX_CONDITIONS 16
+
+/* Comparisons a register condition can make, all signed */
+typedef enum {
+  COND_EQ,
+  COND_NE,
+  COND_LT,
+  COND_LE,
+  COND_GT,
+  COND_GE,
+} Comparison;
+
+/* Set while the user steps one instruction at a time */
+extern int debug_stepping;
+
+/* Bits in debug_stop */
+#define DEBUG_STOP_WATCHPOINT 1
+#define DEBUG_STOP_CONDITION 2
+
+/* Nonzero when a watchpoint or condition asked to stop, see debug.c */
+extern int debug_stop;
+
+extern Word debug_breakpoints[MEMORY_SPACE / 2 / 32];
+extern int debug_condition_count;
+
+int debug_add_breakpoint(Address pc);
+int debug_remove_breakpoint(Address pc);
+int debug_add_watchpoint(Address address, Word length);
+int debug_remove_watchpoint(Address address);
+int debug_add_condition(Processor *, unsigned int reg, Comparison, Word value);
+void debug_clear_conditions(void);
+void debug_watch_store(Address address, Alignment alignment);
+void debug_check_conditions(Processor *);
+Address debug_watch_hit(void);
+void debug_report(Address pc);
+void debug_list(void);
+
+
+static inline int debug_breakpoint_at(Address pc) {
+  Address slot = pc >> 1;
+  return slot < MEMORY_SPACE / 2 && (debug_breakpoints[slot >> 5] >> (slot & 31) & 1);
+}
+
+
+/* Whether to hand control to the user before executing at processor->PC */
+static inline int debug_should_pause(Processor *processor) {
+  return debug_stepping | debug_stop | debug_breakpoint_at(processor->PC);
+}
+
+#endif
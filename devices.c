@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "devices.h"
+#include "bus.h"
+#include "riscv.h"
+#include "console.h"
+#include "csr.h"
+#include "replay.h"
+
+
+/* The device models behind bus.c. What the guest reads from the host,
+   input bytes and the clock, goes through replay_input() so that
+   interactive mode can go back over it. The block device is not undone
+   by going back: its file keeps whatever was written */
+
+
+/* Bytes of register r in a store of alignment bytes at offset, merged
+   into old. Devices with word registers take partial stores this way */
+static Word merge(Word old, Address offset, Alignment alignment, Word value) {
+  Word shift = 8 * (offset & 3), mask = alignment == LENGTH_WORD ? 0xffffffff : ((1u << 8 * alignment) - 1) << shift;
+  return (old & ~mask) | ((value << shift) & mask);
+}
+
+
+static Word extract(Word word, Address offset, Alignment alignment) {
+  Word value = word >> 8 * (offset & 3);
+  return alignment == LENGTH_WORD ? value : value & ((1u << 8 * alignment) - 1);
+}
+
+
+/* UART. A thread moves standard input into the ring, started by the
+   first read so that programs that never read leave stdin alone */
+
+static Byte ring[UART_RING_SIZE];
+static Word ring_head, ring_tail; // bytes taken, bytes put
+static int input_ended;
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ring_space = PTHREAD_COND_INITIALIZER;
+static pthread_t reader;
+static int reading;
+
+
+static void *read_input(void *unused) {
+  Byte byte;
+  while (read(STDIN_FILENO, &byte, 1) == 1) {
+    pthread_mutex_lock(&ring_lock);
+    while (ring_tail - ring_head == UART_RING_SIZE) pthread_cond_wait(&ring_space, &ring_lock);
+    ring[ring_tail++ % UART_RING_SIZE] = byte;
+    pthread_mutex_unlock(&ring_lock);
+  }
+  pthread_mutex_lock(&ring_lock);
+  input_ended = 1;
+  pthread_mutex_unlock(&ring_lock);
+  return NULL;
+}
+
+
+/* The next input byte, -1 if none has arrived, or RECEIVE_ENDED if none
+   ever will */
+#define RECEIVE_ENDED -2
+
+static int receive(int take) {
+  int byte = -1;
+  if (!reading) {
+    reading = 1;
+    pthread_create(&reader, NULL, read_input, NULL);
+    pthread_detach(reader);
+  }
+  pthread_mutex_lock(&ring_lock);
+  if (ring_head != ring_tail) {
+    byte = ring[ring_head % UART_RING_SIZE];
+    if (take) {
+      ring_head++;
+      pthread_cond_signal(&ring_space);
+    }
+  } else if (input_ended) {
+    byte = RECEIVE_ENDED;
+  }
+  pthread_mutex_unlock(&ring_lock);
+  return byte;
+}
+
+
+static Word uart_load(Byte *memory, Address offset, Alignment alignment) {
+  Word value;
+  int byte;
+
+  if (offset != UART_RBR && offset != UART_LSR) return 0;
+  if (replay_input(&value)) return value;
+  byte = receive(offset == UART_RBR);
+  if (offset == UART_RBR) value = byte < 0 ? 0 : byte;
+  else value = UART_LSR_THR_EMPTY | (byte >= 0 ? UART_LSR_DATA_READY : byte == RECEIVE_ENDED ? UART_LSR_INPUT_ENDED : 0);
+  replay_record_input(value);
+  return value;
+}
+
+
+static void uart_store(Byte *memory, Address offset, Alignment alignment, Word value) {
+  Byte byte = value;
+  if (offset == UART_THR) console_write(1, &byte, 1);
+}
+
+
+static const Device uart = { "uart", UART_BASE, DEVICE_SIZE, uart_load, uart_store };
+
+
+/* Timer */
+
+static Double mtimecmp = ~(Double) 0;
+
+
+static Word timer_register(Address offset) {
+  switch (offset & ~3) {
+    case TIMER_MTIME:
+      return csr_time(0);
+    case TIMER_MTIME + 4:
+      return csr_time(1);
+    case TIMER_MTIMECMP:
+      return mtimecmp;
+    case TIMER_MTIMECMP + 4:
+      return mtimecmp >> 32;
+    case TIMER_STATUS:
+      return csr_clock() >= mtimecmp;
+  }
+  return 0;
+}
+
+
+static Word timer_load(Byte *memory, Address offset, Alignment alignment) {
+  return extract(timer_register(offset), offset, alignment);
+}
+
+
+static void timer_store(Byte *memory, Address offset, Alignment alignment, Word value) {
+  switch (offset & ~3) {
+    case TIMER_MTIMECMP:
+      mtimecmp = (mtimecmp & ~(Double) 0xffffffff) | merge(mtimecmp, offset, alignment, value);
+      break;
+    case TIMER_MTIMECMP + 4:
+      mtimecmp = (mtimecmp & 0xffffffff) | (Double) merge(mtimecmp >> 32, offset, alignment, value) << 32;
+      break;
+  }
+}
+
+
+static const Device timer = { "timer", TIMER_BASE, DEVICE_SIZE, timer_load, timer_store };
+
+
+/* Block device */
+
+static int disk_fd = -1;
+static Word disk_registers[DISK_CAPACITY / 4 + 1];
+
+
+/* A DMA write to guest memory is a store as far as the hooks go */
+static void dma_hooks(Address address, size_t length) {
+  Address page;
+  for (page = address >> PAGE_SHIFT; page <= (address + length - 1) >> PAGE_SHIFT; page++) {
+    if (page_hooks[page]) {
+      store_hook(address, length);
+      return;
+    }
+  }
+}
+
+
+/* Runs the command in the registers. Guest memory it writes goes through
+   the store hooks like any other store */
+static Word disk_command(Byte *memory, Word command) {
+  Word sector = disk_registers[DISK_SECTOR / 4], address = disk_registers[DISK_ADDRESS / 4];
+  Word count = disk_registers[DISK_COUNT / 4];
+  size_t length = (size_t) count * DISK_SECTOR_SIZE;
+  off_t position = (off_t) sector * DISK_SECTOR_SIZE;
+
+  if (count == 0) return 0;
+  if (sector + (Double) count > disk_registers[DISK_CAPACITY / 4] || address == 0 ||
+      address >= MEMORY_SPACE || length > MEMORY_SPACE - address) {
+    return 1;
+  }
+  switch (command) {
+    case DISK_READ:
+      dma_hooks(address, length);
+      return pread(disk_fd, memory + address, length, position) != (ssize_t) length;
+    case DISK_WRITE:
+      return pwrite(disk_fd, memory + address, length, position) != (ssize_t) length;
+  }
+  return 1;
+}
+
+
+static Word disk_load(Byte *memory, Address offset, Alignment alignment) {
+  if (offset > DISK_CAPACITY + 3) return 0;
+  return extract(disk_registers[offset / 4], offset, alignment);
+}
+
+
+static void disk_store(Byte *memory, Address offset, Alignment alignment, Word value) {
+  Word *reg = &disk_registers[offset / 4];
+  switch (offset & ~3) {
+    case DISK_SECTOR:
+    case DISK_ADDRESS:
+    case DISK_COUNT:
+      *reg = merge(*reg, offset, alignment, value);
+      break;
+    case DISK_COMMAND:
+      disk_registers[DISK_STATUS / 4] = disk_command(memory, merge(0, offset, alignment, value));
+      break;
+  }
+}
+
+
+static const Device disk = { "disk", DISK_BASE, DEVICE_SIZE, disk_load, disk_store };
+
+
+void devices_init(const char *filename) {
+  struct stat status;
+
+  bus_attach(&uart);
+  bus_attach(&timer);
+  if (filename == NULL) return;
+
+  if ((disk_fd = open(filename, O_RDWR)) < 0 || fstat(disk_fd, &status) != 0) {
+    perror(filename);
+    exit(-1);
+  }
+  disk_registers[DISK_CAPACITY / 4] = status.st_size / DISK_SECTOR_SIZE;
+  bus_attach(&disk);
+}
@@ -0,0 +1,45 @@
+#ifndef DEVICES_H
+#define DEVICES_H
+
+/* Where the devices sit, past the end of RAM */
+#define UART_BASE 0x10000000
+#define TIMER_BASE 0x10001000
+#define DISK_BASE 0x10002000
+#define DEVICE_SIZE 0x1000
+
+/* UART: the byte registers of a 16550, of which only these do anything.
+   Reading RBR takes the next byte of the simulator's standard input */
+#define UART_RBR 0 // read: received byte, 0 when there is none
+#define UART_THR 0 // write: byte to send to standard output
+#define UART_LSR 5 // read: line status
+#define UART_LSR_DATA_READY 0x01
+#define UART_LSR_INPUT_ENDED 0x10 // the break bit: standard input ended and every byte was read
+#define UART_LSR_THR_EMPTY 0x20
+
+/* Host input waiting for the guest, before the reader thread blocks */
+#define UART_RING_SIZE 4096
+
+/* Timer: word registers. mtime counts microseconds, from the clock the
+   time CSR reads. There are no interrupts, so software polls STATUS */
+#define TIMER_MTIME 0x0     // and 0x4 for the high half
+#define TIMER_MTIMECMP 0x8  // and 0xc, read and write
+#define TIMER_STATUS 0x10   // 1 once mtime >= mtimecmp
+
+/* Block device: word registers. Writing COMMAND moves COUNT sectors
+   between SECTOR of the host file and guest memory at ADDRESS before the
+   store completes, then STATUS says how it went */
+#define DISK_SECTOR 0x0
+#define DISK_ADDRESS 0x4
+#define DISK_COUNT 0x8
+#define DISK_COMMAND 0xc  // DISK_READ or DISK_WRITE
+#define DISK_STATUS 0x10  // 0, or 1 after a failed command
+#define DISK_CAPACITY 0x14 // in sectors, read only
+#define DISK_READ 1
+#define DISK_WRITE 2
+#define DISK_SECTOR_SIZE 512
+
+/* Puts the UART and the timer on the bus, and a block device backed by
+   disk if there is one */
+void devices_init(const char *disk);
+
+#endif
@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "disasm.h"
+#include "riscv.h"
+#include "utils.h"
+
+
+/* The -d pipeline: the image is mmap'd and cut into chunks at line
+   boundaries, workers disassemble chunks into their own buffers, and the
+   main thread writes the buffers out in image order as they complete.
+   Lines are split exactly as load_program()'s fgets() would split them.
+
+   Each line is a word, but with the C extension a word can hold two
+   instructions, or the end of one and the start of the next. Where a
+   chunk starts in that stream depends on every chunk before it, so the
+   counting pass also works out, for both ways a chunk can start, how it
+   ends, and the chunks are then chained in order */
+
+/* load_program() reads lines with fgets() into a 50 byte buffer */
+#define LINE_MAX_SIZE 49
+
+/* Chunks that may be in flight ahead of the one being written */
+#define DISASM_WINDOW 4
+
+typedef struct {
+  const char *start, *end;
+  const char *text_end; // of the whole image, for instructions split across lines
+  size_t lines;
+  Address address;  // of the first line in the chunk
+  int tail;         // whether its first halfword ends an instruction
+  int tail_after[2]; // whether the next chunk's does, by this one's tail
+  char *out;
+  size_t len;
+  int done;
+} Chunk;
+
+typedef struct {
+  Chunk *chunks;
+  int count;
+  int threads;
+  int next;     // next chunk to hand to a worker
+  int written;  // chunks already written out
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+} Pipeline;
+
+
+/* End of the line starting at p, the way fgets() would cut it */
+static const char *line_end(const char *p, const char *end) {
+  size_t max = end - p < LINE_MAX_SIZE ? end - p : LINE_MAX_SIZE;
+  const char *newline = memchr(p, '\n', max);
+  return newline ? newline + 1 : p + max;
+}
+
+
+
+
+static int hex_digit(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+
+/* Same result as (int32_t) strtol(line, NULL, 16) on the line */
+static Word parse_line(const char *p, const char *end) {
+  Double value = 0;
+  int negative = 0, overflow = 0, digit;
+
+  while (p < end && (*p == ' ' || (*p >= '\t' && *p <= '\r'))) p++;
+  if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+  if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X') && hex_digit(p[2]) >= 0) p += 2;
+  for (; p < end && (digit = hex_digit(*p)) >= 0; p++) {
+    if (value > (Double) INT64_MAX >> 4) overflow = 1;
+    value = value << 4 | digit;
+    if (value > (Double) INT64_MAX) overflow = 1;
+  }
+  // strtol clamps out of range values to LONG_MIN/LONG_MAX
+  if (overflow) return negative ? 0 : 0xFFFFFFFF;
+  return negative ? -value : value;
+}
+
+
+/* Whether the word after one that started with tail ends with the
+   first half of a 4-byte instruction */
+static int next_tail(Word word, int tail) {
+  if (!tail && !is_compressed(word)) return 0;
+  return !is_compressed(word >> 16);
+}
+
+
+static void count_lines(Chunk *chunk) {
+  const char *p = chunk->start, *end;
+  Word word;
+  int tail[2] = { 0, 1 };
+
+  chunk->lines = 0;
+  while (p < chunk->end) {
+    end = line_end(p, chunk->end);
+    word = parse_line(p, end);
+    tail[0] = next_tail(word, tail[0]);
+    tail[1] = next_tail(word, tail[1]);
+    chunk->lines++;
+    p = end;
+  }
+  chunk->tail_after[0] = tail[0];
+  chunk->tail_after[1] = tail[1];
+}
+
+
+static char *disassemble_at(char *out, Address address, Word bits) {
+  Instruction instruction = { .bits = bits };
+  out = format_hex(out, address, 8);
+  *out++ = ':';
+  *out++ = ' ';
+  return disassemble(out, instruction);
+}
+
+
+static void disassemble_chunk(Chunk *chunk) {
+  const char *p = chunk->start;
+  Address address = chunk->address;
+  char *out = chunk->out = malloc(2 * chunk->lines * DISASM_MAX_LINE);
+  int tail = chunk->tail;
+  Word word, next;
+
+  while (p < chunk->end) {
+    const char *end = line_end(p, chunk->end);
+    word = parse_line(p, end);
+    if (!tail && !is_compressed(word)) {
+      out = disassemble_at(out, address, word);
+    } else {
+      if (!tail) out = disassemble_at(out, address, word & 0xFFFF);
+      tail = next_tail(word, tail);
+      if (!tail) {
+        out = disassemble_at(out, address + 2, word >> 16);
+      } else {
+        // finished by the next line, if there is one
+        next = end < chunk->text_end ? parse_line(end, line_end(end, chunk->text_end)) : 0;
+        out = disassemble_at(out, address + 2, word >> 16 | next << 16);
+      }
+    }
+    address += 4;
+    p = end;
+  }
+  chunk->len = out - chunk->out;
+}
+
+
+/* Chunk addresses depend on the line counts of all earlier chunks, so
+   counting is a separate pass, split the same way */
+typedef struct {
+  Pipeline *pipeline;
+  int first;
+} Counter;
+
+static void *counter(void *arg) {
+  Counter *counter = arg;
+  Pipeline *pipeline = counter->pipeline;
+  int i;
+  for (i = counter->first; i < pipeline->count; i += pipeline->threads) {
+    count_lines(&pipeline->chunks[i]);
+  }
+  return NULL;
+}
+
+
+static void *worker(void *arg) {
+  Pipeline *pipeline = arg;
+  Chunk *chunk;
+
+  pthread_mutex_lock(&pipeline->lock);
+  while (pipeline->next < pipeline->count) {
+    // bound the memory held by finished but unwritten chunks
+    if (pipeline->next >= pipeline->written + DISASM_WINDOW) {
+      pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+      continue;
+    }
+    chunk = &pipeline->chunks[pipeline->next++];
+    pthread_mutex_unlock(&pipeline->lock);
+
+    disassemble_chunk(chunk);
+
+    pthread_mutex_lock(&pipeline->lock);
+    chunk->done = 1;
+    pthread_cond_broadcast(&pipeline->changed);
+  }
+  pthread_mutex_unlock(&pipeline->lock);
+  return NULL;
+}
+
+
+/* Disassembles an image in the format load_program() reads to stdout,
+   as if it had been loaded at startaddr */
+int disassemble_file(const char *filename, Address startaddr, int threads) {
+  struct stat st;
+  const char *text, *p, *end;
+  Pipeline pipeline;
+  pthread_t *workers;
+  Counter *counters;
+  Address address = startaddr;
+  int fd, i;
+
+  fd = open(filename, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    perror(filename);
+    return -1;
+  }
+  if (st.st_size == 0) {
+    close(fd);
+    return 0;
+  }
+  text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (text == MAP_FAILED) {
+    perror(filename);
+    return -1;
+  }
+  madvise((void *) text, st.st_size, MADV_SEQUENTIAL);
+  end = text + st.st_size;
+
+  /* cut the text right after a newline close to every chunk boundary */
+  pipeline.count = 0;
+  pipeline.chunks = malloc((st.st_size / DISASM_CHUNK_SIZE + 1) * sizeof(Chunk));
+  for (p = text; p < end; pipeline.count++) {
+    Chunk *chunk = &pipeline.chunks[pipeline.count];
+    const char *cut = end - p > DISASM_CHUNK_SIZE ? p + DISASM_CHUNK_SIZE : end;
+    const char *newline = memchr(cut, '\n', end - cut);
+    chunk->start = p;
+    chunk->end = newline ? newline + 1 : end;
+    chunk->text_end = end;
+    chunk->done = 0;
+    p = chunk->end;
+  }
+
+  if (threads > pipeline.count) threads = pipeline.count;
+  if (threads < 1) threads = 1;
+  pipeline.threads = threads;
+  workers = malloc(threads * sizeof(pthread_t));
+  counters = malloc(threads * sizeof(Counter));
+  for (i = 0; i < threads; i++) {
+    counters[i].pipeline = &pipeline;
+    counters[i].first = i;
+    pthread_create(&workers[i], NULL, counter, &counters[i]);
+  }
+  for (i = 0; i < threads; i++) pthread_join(workers[i], NULL);
+  free(counters);
+  for (i = 0; i < pipeline.count; i++) {
+    pipeline.chunks[i].address = address;
+    pipeline.chunks[i].tail = i ? pipeline.chunks[i - 1].tail_after[pipeline.chunks[i - 1].tail] : 0;
+    address += 4 * pipeline.chunks[i].lines;
+  }
+
+  pipeline.next = pipeline.written = 0;
+  pthread_mutex_init(&pipeline.lock, NULL);
+  pthread_cond_init(&pipeline.changed, NULL);
+  for (i = 0; i < threads; i++) pthread_create(&workers[i], NULL, worker, &pipeline);
+
+  /* write the chunks out in order */
+  pthread_mutex_lock(&pipeline.lock);
+  while (pipeline.written < pipeline.count) {
+    Chunk *chunk = &pipeline.chunks[pipeline.written];
+    if (!chunk->done) {
+      pthread_cond_wait(&pipeline.changed, &pipeline.lock);
+      continue;
+    }
+    pthread_mutex_unlock(&pipeline.lock);
+    fwrite(chunk->out, 1, chunk->len, stdout);
+    free(chunk->out);
+    pthread_mutex_lock(&pipeline.lock);
+    pipeline.written++;
+    pthread_cond_broadcast(&pipeline.changed);
+  }
+  pthread_mutex_unlock(&pipeline.lock);
+
+  for (i = 0; i < threads; i++) pthread_join(workers[i], NULL);
+  pthread_mutex_destroy(&pipeline.lock);
+  pthread_cond_destroy(&pipeline.changed);
+  free(workers);
+  free(pipeline.chunks);
+  munmap((void *) text, st.st_size);
+  return 0;
+}
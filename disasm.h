@@ -0,0 +1,11 @@
+#ifndef DISASM_H
+#define DISASM_H
+
+#include "types.h"
+
+/* Bytes of image text handed to a worker at a time */
+#define DISASM_CHUNK_SIZE (256 * 1024)
+
+int disassemble_file(const char *filename, Address startaddr, int threads);
+
+#endif
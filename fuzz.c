@@ -0,0 +1,326 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "fuzz.h"
+#include "riscv.h"
+#include "hart.h"
+#include "coverage.h"
+#include "console.h"
+#include "utils.h"
+
+
+/* Coverage-guided fuzzing in a single process. Each run starts from the
+   memory as loaded: pages written by the previous run are found through
+   PAGE_HOOK_DIRTY and copied back, so a reset costs a few pages rather
+   than MEMORY_SPACE. Ends of the program, normal or not, come back here
+   through halt_hook instead of exiting.
+
+   Inputs that take a branch direction or reach an instruction no earlier
+   input did join the corpus. Runs that end in an invalid instruction or
+   access are crashes, saved once per faulting PC */
+
+#define STATUS_HANG 1
+
+typedef struct {
+  Byte *data;
+  Word length;
+} Input;
+
+static Byte *pristine;
+static Address dirty[PAGE_COUNT];
+static int dirty_count;
+
+static jmp_buf run_end;
+static int run_status;
+
+static Byte *seen;
+static Address crash_sites[FUZZ_MAX_CRASHES];
+static int crash_count;
+
+static Input *corpus;
+static int corpus_count, corpus_capacity;
+
+static Runner run_steps;
+
+static volatile sig_atomic_t interrupted;
+static Double random_state;
+
+
+void fuzz_mark_dirty(Address page) {
+  dirty[dirty_count++] = page;
+  page_hooks[page] &= ~PAGE_HOOK_DIRTY;
+}
+
+
+static void reset_memory(Byte *memory) {
+  Address page;
+  while (dirty_count) {
+    page = dirty[--dirty_count];
+    memcpy(memory + (page << PAGE_SHIFT), pristine + (page << PAGE_SHIFT), PAGE_SIZE);
+    page_hooks[page] |= PAGE_HOOK_DIRTY;
+  }
+}
+
+
+void fuzz_place_input(Processor *processor, Byte *memory, const Byte *input, Word length) {
+  Address page;
+  for (page = FUZZ_INPUT_ADDRESS >> PAGE_SHIFT; page <= (FUZZ_INPUT_ADDRESS + FUZZ_MAX_INPUT - 1) >> PAGE_SHIFT; page++) {
+    if (page_hooks[page] & PAGE_HOOK_DIRTY) fuzz_mark_dirty(page);
+  }
+  memcpy(memory + FUZZ_INPUT_ADDRESS, input, length);
+  processor->R[11] = FUZZ_INPUT_ADDRESS;
+  processor->R[12] = length;
+}
+
+
+int fuzz_load_input(Processor *processor, Byte *memory, const char *filename) {
+  Byte input[FUZZ_MAX_INPUT];
+  FILE *file = fopen(filename, "rb");
+  size_t length;
+  if (file == NULL) return 0;
+  length = fread(input, 1, sizeof(input), file);
+  fclose(file);
+  fuzz_place_input(processor, memory, input, length);
+  return 1;
+}
+
+
+static void end_run(int status) {
+  run_status = status;
+  longjmp(run_end, 1);
+}
+
+
+/* Runs input once from reset. Returns 0, or the guest's exit status, or
+   STATUS_HANG. The exit status of a crash is negative */
+static int run(Processor *processor, Byte *memory, const Byte *input, Word length) {
+  reset_memory(memory);
+  hart_reset(processor, 0);
+  fuzz_place_input(processor, memory, input, length);
+
+  if (setjmp(run_end)) return run_status;
+  run_steps(processor, FUZZ_MAX_STEPS);
+  return STATUS_HANG;
+}
+
+
+/* Folds this run's counts into what all runs have covered. Returns
+   whether it covered anything new */
+static int new_coverage(void) {
+  Word i, pairs = 2 * coverage_slots;
+  int found = 0;
+  for (i = 0; i < pairs; i++) {
+    if (coverage_counts[i] && !seen[i]) {
+      seen[i] = 1;
+      found = 1;
+    }
+  }
+  memset(coverage_counts, 0, (pairs + 2) * sizeof(Double));
+  return found;
+}
+
+
+static Word random_below(Word n) {
+  // xorshift64*
+  random_state ^= random_state >> 12;
+  random_state ^= random_state << 25;
+  random_state ^= random_state >> 27;
+  return (random_state * 0x2545F4914F6CDD1DULL >> 32) % n;
+}
+
+
+/* A few random edits to input. Returns the new length */
+static Word mutate(Byte *input, Word length) {
+  static const Byte interesting[] = { 0x00, 0x01, 0x7f, 0x80, 0xff, '\n', ' ', '0' };
+  Word edits = 1 + random_below(4), at;
+
+  while (edits--) {
+    at = length ? random_below(length) : 0;
+    switch (random_below(length ? 6 : 1)) {
+      case 0: // insert a byte
+        if (length == FUZZ_MAX_INPUT) break;
+        memmove(input + at + 1, input + at, length - at);
+        input[at] = random_below(256);
+        length++;
+        break;
+      case 1: // delete one
+        memmove(input + at, input + at + 1, length - at - 1);
+        length--;
+        break;
+      case 2:
+        input[at] ^= 1 << random_below(8);
+        break;
+      case 3:
+        input[at] = random_below(256);
+        break;
+      case 4:
+        input[at] = interesting[random_below(sizeof(interesting))];
+        break;
+      case 5:
+        input[at] += random_below(33) - 16;
+        break;
+    }
+  }
+  return length;
+}
+
+
+static Double hash(const Byte *data, Word length) {
+  Double h = 0xcbf29ce484222325ULL; // FNV-1a
+  while (length--) h = (h ^ *data++) * 0x100000001b3ULL;
+  return h;
+}
+
+
+static void save(const char *directory, const char *kind, const Byte *input, Word length) {
+  char path[4096];
+  FILE *file;
+  snprintf(path, sizeof(path), "%s/%s-%016llx", directory, kind, (unsigned long long) hash(input, length));
+  if ((file = fopen(path, "wb")) == NULL) {
+    perror(path);
+    return;
+  }
+  fwrite(input, 1, length, file);
+  fclose(file);
+}
+
+
+static void add_to_corpus(const Byte *input, Word length) {
+  if (corpus_count == corpus_capacity) {
+    corpus_capacity = corpus_capacity ? 2 * corpus_capacity : 64;
+    corpus = realloc(corpus, corpus_capacity * sizeof(Input));
+  }
+  corpus[corpus_count].data = malloc(length ? length : 1);
+  memcpy(corpus[corpus_count].data, input, length);
+  corpus[corpus_count].length = length;
+  corpus_count++;
+}
+
+
+/* Saves the input if it is the first to crash at the PC */
+static int new_crash(Address pc) {
+  int i;
+  for (i = 0; i < crash_count; i++) {
+    if (crash_sites[i] == pc) return 0;
+  }
+  if (crash_count == FUZZ_MAX_CRASHES) return 0;
+  crash_sites[crash_count++] = pc;
+  return 1;
+}
+
+
+/* Runs input and keeps it if it is interesting. Returns its status */
+static int try_input(Processor *processor, Byte *memory, const char *directory,
+                     const Byte *input, Word length, int from_disk) {
+  int status = run(processor, memory, input, length);
+
+  if (new_coverage()) {
+    add_to_corpus(input, length);
+    if (!from_disk) save(directory, "id", input, length);
+  }
+  if (status < 0 && new_crash(processor->PC)) {
+    save(directory, "crash", input, length);
+    fprintf(stderr, "crash at %08x, status %d\n", processor->PC, status);
+  } else if (status == STATUS_HANG && new_crash(processor->PC)) {
+    save(directory, "hang", input, length);
+    fprintf(stderr, "hang at %08x\n", processor->PC);
+  }
+  return status;
+}
+
+
+/* Seeds from the id- files of an earlier session, or an empty input */
+static void load_corpus(Processor *processor, Byte *memory, const char *directory) {
+  Byte input[FUZZ_MAX_INPUT];
+  char path[4096];
+  struct dirent *entry;
+  FILE *file;
+  size_t length;
+  DIR *dir = opendir(directory);
+
+  if (dir == NULL) {
+    mkdir(directory, 0777);
+    dir = opendir(directory);
+  }
+  if (dir == NULL) {
+    perror(directory);
+    exit(-1);
+  }
+  while ((entry = readdir(dir)) != NULL) {
+    if (strncmp(entry->d_name, "id-", 3) != 0) continue;
+    snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+    if ((file = fopen(path, "rb")) == NULL) continue;
+    length = fread(input, 1, sizeof(input), file);
+    fclose(file);
+    try_input(processor, memory, directory, input, length, 1);
+  }
+  closedir(dir);
+  if (corpus_count == 0) try_input(processor, memory, directory, input, 0, 0);
+  if (corpus_count == 0) add_to_corpus(input, 0);
+}
+
+
+static void stop(int number) {
+  interrupted = 1;
+}
+
+
+static Word covered(void) {
+  Word i, count = 0;
+  for (i = 0; i < 2 * coverage_slots; i++) count += seen[i];
+  return count;
+}
+
+
+void fuzz_run(Processor *processor, Byte *memory, Word size, const char *directory) {
+  Byte input[FUZZ_MAX_INPUT];
+  Double executions = 0, last_executions = 0;
+  time_t start = time(NULL), last_report = start, now;
+  Input *parent;
+  Word length;
+  int page, devnull;
+
+  if (coverage_counts == NULL) coverage_init(0x1000, size, memory, NULL);
+  seen = calloc(2 * coverage_slots + 2, 1);
+  run_steps = run_loop(0, 0);
+
+  pristine = malloc(MEMORY_SPACE);
+  memcpy(pristine, memory, MEMORY_SPACE);
+  for (page = 0; page < PAGE_COUNT; page++) page_hooks[page] |= PAGE_HOOK_DIRTY;
+
+  // the program's own output and the simulator's messages about it
+  console_mute(1);
+  fflush(stdout);
+  if ((devnull = open("/dev/null", O_WRONLY)) >= 0) dup2(devnull, STDOUT_FILENO);
+  halt_hook = end_run;
+
+  random_state = (Double) time(NULL) << 20 ^ getpid();
+  signal(SIGINT, stop);
+  load_corpus(processor, memory, directory);
+
+  while (!interrupted) {
+    parent = &corpus[random_below(corpus_count)];
+    memcpy(input, parent->data, parent->length);
+    length = mutate(input, parent->length);
+    try_input(processor, memory, directory, input, length, 0);
+    executions++;
+
+    if ((executions & 1023) == 0 && (now = time(NULL)) != last_report) {
+      fprintf(stderr, "%llu runs, %llu/s, corpus %d, %u edges covered, %d crashes\n",
+              (unsigned long long) executions, (unsigned long long) (executions - last_executions) / (now - last_report),
+              corpus_count, covered(), crash_count);
+      last_report = now;
+      last_executions = executions;
+    }
+  }
+  fprintf(stderr, "%llu runs in %lds, corpus %d, %d crashes\n",
+          (unsigned long long) executions, (long) (time(NULL) - start), corpus_count, crash_count);
+  exit(0);
+}
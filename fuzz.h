@@ -0,0 +1,29 @@
+#ifndef FUZZ_H
+#define FUZZ_H
+
+#include "types.h"
+
+/* Where a fuzz input goes in guest memory. At reset a1 holds its address
+   and a2 its length */
+#define FUZZ_INPUT_ADDRESS 0x80000
+#define FUZZ_MAX_INPUT 4096
+
+/* A run that has not ended after this many instructions is a hang */
+#define FUZZ_MAX_STEPS (1 << 20)
+
+/* Crash sites remembered, beyond which new ones are no longer saved */
+#define FUZZ_MAX_CRASHES 256
+
+void fuzz_place_input(Processor *, Byte *memory, const Byte *input, Word length);
+
+/* Places the contents of filename, e.g. a saved reproducer. Returns 0 if
+   it cannot be read */
+int fuzz_load_input(Processor *, Byte *memory, const char *filename);
+
+/* Fuzzes the program loaded in the size bytes at 0x1000, keeping its
+   corpus in directory. Runs until interrupted */
+void fuzz_run(Processor *, Byte *memory, Word size, const char *directory);
+
+void fuzz_mark_dirty(Address page);
+
+#endif
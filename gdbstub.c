@@ -0,0 +1,456 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "gdbstub.h"
+#include "riscv.h"
+#include "debug.h"
+#include "console.h"
+#include "utils.h"
+
+
+/* A gdb remote serial protocol target, enough for gdb's target remote:
+   registers, memory, breakpoints, write watchpoints, step and continue.
+
+   Continuing runs the same execute() loop as a plain run. Between
+   instructions it only tests the breakpoint bitmap and debug_stop, and
+   looks at the socket for an interrupt every GDBSTUB_POLL_INTERVAL
+   instructions */
+
+#define SIGNAL_INT 2
+#define SIGNAL_TRAP 5
+
+/* gdb numbers x0-x31 first, then the pc */
+#define REGISTER_PC 32
+#define REGISTER_COUNT 33
+
+static const char *register_names[32] = {
+  "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
+  "fp", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+  "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7",
+  "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6",
+};
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static int client = -1;
+static int no_ack;
+
+static Byte received[GDBSTUB_PACKET_SIZE];
+static int received_length, received_next;
+
+static char target_xml[2048];
+static int target_xml_length;
+
+
+static void build_target_xml(void) {
+  char *out = target_xml;
+  int i;
+  out += sprintf(out,
+    "<?xml version=\"1.0\"?>\n"
+    "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">\n"
+    "<target version=\"1.0\">\n"
+    "<architecture>riscv:rv32</architecture>\n"
+    "<feature name=\"org.gnu.gdb.riscv.cpu\">\n");
+  for (i = 0; i < 32; i++) {
+    out += sprintf(out, "<reg name=\"%s\" bitsize=\"32\" type=\"%s\" regnum=\"%d\"/>\n",
+                   register_names[i], i == 1 ? "code_ptr" : i == 2 ? "data_ptr" : "int", i);
+  }
+  out += sprintf(out, "<reg name=\"pc\" bitsize=\"32\" type=\"code_ptr\" regnum=\"%d\"/>\n"
+                 "</feature>\n</target>\n", REGISTER_PC);
+  target_xml_length = out - target_xml;
+}
+
+
+/* Next byte from gdb, or -1 once it has gone */
+static int get_char(void) {
+  if (received_next == received_length) {
+    received_length = recv(client, received, sizeof(received), 0);
+    received_next = 0;
+    if (received_length <= 0) {
+      received_length = 0;
+      return -1;
+    }
+  }
+  return received[received_next++];
+}
+
+
+static void put(const char *data, size_t length) {
+  send(client, data, length, MSG_NOSIGNAL);
+}
+
+
+static int hex_value(int c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+
+/* Reads hex digits at *text, leaving *text after them */
+static Word parse_hex(const char **text) {
+  Word value = 0;
+  int digit;
+  while ((digit = hex_value(**text)) >= 0) {
+    value = value << 4 | digit;
+    (*text)++;
+  }
+  return value;
+}
+
+
+/* Target byte order, as gdb wants register contents */
+static char *format_word(char *out, Word value) {
+  int i;
+  for (i = 0; i < 4; i++, value >>= 8) {
+    *out++ = hex_digits[value >> 4 & 0xf];
+    *out++ = hex_digits[value & 0xf];
+  }
+  return out;
+}
+
+
+static Word parse_word(const char **text) {
+  Word value = 0;
+  int i, hi, lo;
+  for (i = 0; i < 4; i++) {
+    hi = hex_value((*text)[0]);
+    lo = hex_value(hi < 0 ? 0 : (*text)[1]);
+    if (lo < 0) break;
+    value |= (Word) (hi << 4 | lo) << 8 * i;
+    *text += 2;
+  }
+  return value;
+}
+
+
+/* Reads one packet into packet, acknowledging it. Returns its length, or
+   -1 once gdb has gone. A lone interrupt while stopped reads as empty */
+static int receive_packet(char *packet) {
+  int c, hi, lo, length;
+  Byte sum;
+
+  while (1) {
+    do {
+      if ((c = get_char()) < 0) return -1;
+    } while (c != '$');
+
+    length = 0;
+    sum = 0;
+    while ((c = get_char()) >= 0 && c != '#') {
+      if (length < GDBSTUB_PACKET_SIZE - 1) packet[length++] = c;
+      sum += c;
+    }
+    packet[length] = '\0';
+    if (c < 0 || (hi = get_char()) < 0 || (lo = get_char()) < 0) return -1;
+
+    if (no_ack) return length;
+    if (hex_value(hi) << 4 == (sum & 0xf0) && hex_value(lo) == (sum & 0xf)) {
+      put("+", 1);
+      return length;
+    }
+    put("-", 1);
+  }
+}
+
+
+static void send_packet(const char *data) {
+  char frame[GDBSTUB_PACKET_SIZE + 4];
+  size_t length = strlen(data);
+  Byte sum = 0;
+  size_t i;
+  int c;
+
+  frame[0] = '$';
+  for (i = 0; i < length; i++) sum += frame[i + 1] = data[i];
+  frame[length + 1] = '#';
+  frame[length + 2] = hex_digits[sum >> 4];
+  frame[length + 3] = hex_digits[sum & 0xf];
+
+  do {
+    put(frame, length + 4);
+    if (no_ack) return;
+    while ((c = get_char()) >= 0 && c != '+' && c != '-');
+  } while (c == '-');
+}
+
+
+/* Whether gdb sent an interrupt (^C) since the last look */
+static int interrupted(void) {
+  struct pollfd ready = { .fd = client, .events = POLLIN };
+  int c;
+  while (received_next < received_length || poll(&ready, 1, 0) > 0) {
+    if ((c = get_char()) < 0 || c == 0x03) return 1;
+  }
+  return 0;
+}
+
+
+/* Tells gdb the program has exited, see halt_simulation() */
+static void report_exit(int status) {
+  char reply[4];
+  console_flush();
+  if (client < 0) return;
+  sprintf(reply, "W%02x", status & 0xff);
+  send_packet(reply);
+}
+
+
+/* Runs until something gdb should hear about and returns the signal */
+static int resume(Processor *processor, int step) {
+  Word count = 0;
+
+  debug_stop = 0;
+  do {
+    execute(processor, 0, 0);
+    if (step) return SIGNAL_TRAP;
+    if (!(++count & (GDBSTUB_POLL_INTERVAL - 1)) && interrupted()) return SIGNAL_INT;
+  } while (!(debug_stop | debug_breakpoint_at(processor->PC)));
+  return SIGNAL_TRAP;
+}
+
+
+static void stop_reply(char *reply, int signal, int step) {
+  if (signal != SIGNAL_TRAP || step) {
+    sprintf(reply, "S%02x", signal);
+  } else if (debug_stop & DEBUG_STOP_WATCHPOINT) {
+    sprintf(reply, "T%02xwatch:%x;", signal, debug_watch_hit());
+  } else {
+    sprintf(reply, "T%02xswbreak:;", signal);
+  }
+  debug_stop = 0;
+}
+
+
+static int read_memory(char *reply, Byte *memory, const char *args) {
+  Address address = parse_hex(&args);
+  Word length;
+  if (*args++ != ',') return 0;
+  length = parse_hex(&args);
+  if (address >= MEMORY_SPACE) return 0;
+  if (length > MEMORY_SPACE - address) length = MEMORY_SPACE - address;
+  if (length > (GDBSTUB_PACKET_SIZE - 1) / 2) length = (GDBSTUB_PACKET_SIZE - 1) / 2;
+  for (; length; length--, address++) {
+    *reply++ = hex_digits[memory[address] >> 4];
+    *reply++ = hex_digits[memory[address] & 0xf];
+  }
+  *reply = '\0';
+  return 1;
+}
+
+
+/* Debugger writes bypass the store hooks: they are not the program's */
+static int write_memory(Byte *memory, const char *args) {
+  Address address = parse_hex(&args);
+  Word length;
+  int hi, lo;
+  if (*args++ != ',') return 0;
+  length = parse_hex(&args);
+  if (*args++ != ':' || address >= MEMORY_SPACE || length > MEMORY_SPACE - address) return 0;
+  for (; length; length--, args += 2) {
+    if ((hi = hex_value(args[0])) < 0 || (lo = hex_value(args[1])) < 0) return 0;
+    memory[address++] = hi << 4 | lo;
+  }
+  return 1;
+}
+
+
+/* Z and z packets. Returns 1 on success, 0 on failure and -1 for kinds
+   this target does not support */
+static int breakpoint(const char *args, int insert) {
+  int type = *args++ - '0';
+  Address address;
+  Word length;
+  if (*args++ != ',') return 0;
+  address = parse_hex(&args);
+  if (*args++ != ',') return 0;
+  length = parse_hex(&args);
+
+  switch (type) {
+    case 0: // software
+    case 1: // hardware, no different here
+      return insert ? debug_add_breakpoint(address) : (debug_remove_breakpoint(address), 1);
+    case 2: // write watchpoint
+      return insert ? debug_add_watchpoint(address, length) : debug_remove_watchpoint(address);
+    default:
+      return -1;
+  }
+}
+
+
+static void read_features(char *reply, const char *args) {
+  Word offset, length;
+  if (strncmp(args, "target.xml:", 11) != 0) {
+    strcpy(reply, "E00");
+    return;
+  }
+  args += 11;
+  offset = parse_hex(&args);
+  if (*args++ != ',') {
+    strcpy(reply, "E00");
+    return;
+  }
+  length = parse_hex(&args);
+  if (length > GDBSTUB_PACKET_SIZE - 2) length = GDBSTUB_PACKET_SIZE - 2;
+  if (offset >= target_xml_length) {
+    strcpy(reply, "l");
+  } else {
+    if (length > target_xml_length - offset) length = target_xml_length - offset;
+    reply[0] = offset + length < target_xml_length ? 'm' : 'l';
+    memcpy(reply + 1, target_xml + offset, length);
+    reply[length + 1] = '\0';
+  }
+}
+
+
+static int listen_on(const char *where) {
+  struct sockaddr_in address = { .sin_family = AF_INET };
+  char *end;
+  long port = strtol(where, &end, 10);
+  int server, one = 1;
+
+  // a port number, or else the path of a Unix socket
+  if (!*where || *end) return listen_unix(where, 1);
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if ((server = socket(AF_INET, SOCK_STREAM, 0)) < 0) return -1;
+  setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if (bind(server, (struct sockaddr *) &address, sizeof(address)) < 0) return -1;
+  if (listen(server, 1) < 0) return -1;
+  return server;
+}
+
+
+void gdbstub_run(Processor *processor, Byte *memory, const char *where) {
+  static char packet[GDBSTUB_PACKET_SIZE], reply[GDBSTUB_PACKET_SIZE];
+  const char *args;
+  char *out;
+  Word reg, value;
+  int server, signal = SIGNAL_TRAP, one = 1, i, result;
+
+  if ((server = listen_on(where)) < 0) {
+    fprintf(stderr, "cannot listen on %s: %s\n", where, strerror(errno));
+    exit(-1);
+  }
+  fprintf(stderr, "waiting for gdb on %s\n", where);
+  if ((client = accept(server, NULL, NULL)) < 0) {
+    fprintf(stderr, "cannot accept gdb: %s\n", strerror(errno));
+    exit(-1);
+  }
+  close(server);
+  setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  build_target_xml();
+  halt_hook = report_exit;
+  debug_stepping = 0;
+
+  while (receive_packet(packet) >= 0) {
+    args = packet + 1;
+    reply[0] = '\0';
+
+    switch (packet[0]) {
+      case '?':
+        sprintf(reply, "S%02x", signal);
+        break;
+      case 'g':
+        out = reply;
+        for (i = 0; i < 32; i++) out = format_word(out, processor->R[i]);
+        out = format_word(out, processor->PC);
+        *out = '\0';
+        break;
+      case 'G':
+        for (i = 0; i < 32; i++) processor->R[i] = parse_word(&args);
+        processor->PC = parse_word(&args);
+        processor->R[0] = 0;
+        strcpy(reply, "OK");
+        break;
+      case 'p':
+        reg = parse_hex(&args);
+        if (reg >= REGISTER_COUNT) {
+          strcpy(reply, "E01");
+        } else {
+          *format_word(reply, reg == REGISTER_PC ? processor->PC : processor->R[reg]) = '\0';
+        }
+        break;
+      case 'P':
+        reg = parse_hex(&args);
+        if (*args++ != '=' || reg >= REGISTER_COUNT) {
+          strcpy(reply, "E01");
+          break;
+        }
+        value = parse_word(&args);
+        if (reg == REGISTER_PC) processor->PC = value;
+        else if (reg) processor->R[reg] = value;
+        strcpy(reply, "OK");
+        break;
+      case 'm':
+        if (!read_memory(reply, memory, args)) strcpy(reply, "E01");
+        break;
+      case 'M':
+        strcpy(reply, write_memory(memory, args) ? "OK" : "E01");
+        break;
+      case 'Z':
+      case 'z':
+        result = breakpoint(args, packet[0] == 'Z');
+        if (result >= 0) strcpy(reply, result ? "OK" : "E01");
+        break;
+      case 'c':
+      case 's':
+        if (*args) processor->PC = parse_hex(&args);
+        signal = resume(processor, packet[0] == 's');
+        stop_reply(reply, signal, packet[0] == 's');
+        break;
+      case 'k':
+        exit(0);
+      case 'D':
+        // let the program finish on its own
+        send_packet("OK");
+        close(client);
+        client = -1;
+        run_loop(0, 0)(processor, RUN_FOREVER);
+      case 'H':
+      case 'T':
+        strcpy(reply, "OK");
+        break;
+      case 'q':
+        if (strncmp(args, "Supported", 9) == 0) {
+          sprintf(reply, "PacketSize=%x;qXfer:features:read+;swbreak+;QStartNoAckMode+", GDBSTUB_PACKET_SIZE);
+        } else if (strncmp(args, "Xfer:features:read:", 19) == 0) {
+          read_features(reply, args + 19);
+        } else if (strcmp(args, "Attached") == 0) {
+          strcpy(reply, "1");
+        } else if (strcmp(args, "C") == 0) {
+          strcpy(reply, "QC1");
+        } else if (strcmp(args, "fThreadInfo") == 0) {
+          strcpy(reply, "m1");
+        } else if (strcmp(args, "sThreadInfo") == 0) {
+          strcpy(reply, "l");
+        }
+        break;
+      case 'Q':
+        if (strcmp(args, "StartNoAckMode") == 0) {
+          send_packet("OK");
+          no_ack = 1;
+          continue;
+        }
+        break;
+      case 'v':
+        if (strncmp(args, "Kill", 4) == 0) {
+          send_packet("OK");
+          exit(0);
+        }
+        break;
+    }
+    send_packet(reply);
+  }
+  // gdb went away without detaching
+  exit(0);
+}
@@ -0,0 +1,18 @@
+#ifndef GDBSTUB_H
+#define GDBSTUB_H
+
+#include "types.h"
+
+/* Instructions run between checks for an interrupt from gdb while
+   continuing. A power of two */
+#define GDBSTUB_POLL_INTERVAL 65536
+
+/* Largest packet accepted or sent, advertised to gdb in qSupported */
+#define GDBSTUB_PACKET_SIZE 4096
+
+/* Waits for gdb on where, a TCP port on 127.0.0.1 when it is a number
+   and a Unix socket path otherwise, then serves it until the program
+   exits or gdb kills it. Does not return */
+void gdbstub_run(Processor *, Byte *memory, const char *where);
+
+#endif
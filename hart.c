@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "hart.h"
+#include "riscv.h"
+
+
+/* Harts share guest memory and nothing else. The guest tells them apart
+   by a0, which holds the hart id at reset */
+
+void hart_reset(Processor *processor, Word hartid) {
+  int i;
+
+  /* set the PC to 0x1000 */
+  processor->PC = 0x1000;
+
+  /* zero out all registers */
+  for (i = 0; i < 32; i++) processor->R[i] = 0;
+
+  /* Set the global pointer to 0x3000. We arbitrarily call this the middle of the static data segment */
+  processor->R[3] = 0x3000;
+
+  /* Set the stack pointer near the top of the memory array, each hart below the last */
+  processor->R[2] = 0xEFFFF - hartid * HART_STACK_SIZE;
+
+  processor->R[10] = hartid;
+  processor->hartid = hartid;
+  processor->reservation = NO_RESERVATION;
+  memset(&processor->counters, 0, sizeof(processor->counters));
+}
+
+
+/* The run loop of harts on threads of their own */
+static Runner run;
+
+
+static void *run_hart(void *processor) {
+  run(processor, RUN_FOREVER);
+  return NULL;
+}
+
+
+void harts_run(Processor *harts, int count, Word quantum, int prompt, int print) {
+  pthread_t threads[HART_MAX];
+  int hart;
+
+  run = run_loop(prompt, print);
+  if (count == 1) run(harts, RUN_FOREVER);
+
+  if (quantum) {
+    while (1) {
+      for (hart = 0; hart < count; hart++) run(&harts[hart], quantum);
+    }
+  }
+
+  for (hart = 0; hart < count; hart++) {
+    if (pthread_create(&threads[hart], NULL, run_hart, &harts[hart]) != 0) {
+      fprintf(stderr, "cannot start hart %d\n", hart);
+      exit(-1);
+    }
+  }
+  // the simulation ends with the process, from whichever hart ends it
+  for (hart = 0; hart < count; hart++) pthread_join(threads[hart], NULL);
+}
@@ -0,0 +1,22 @@
+#ifndef HART_H
+#define HART_H
+
+#include "types.h"
+
+#define HART_MAX 8
+
+/* Each hart gets its own stack this far below the previous one's */
+#define HART_STACK_SIZE 0x10000
+
+/* Instructions a hart runs before the next one's turn in deterministic
+   mode, unless -q says otherwise */
+#define HART_DEFAULT_QUANTUM 1000
+
+void hart_reset(Processor *, Word hartid);
+
+/* Runs count harts until one of them ends the simulation. With a quantum
+   they take turns on this thread, quantum instructions at a time, so
+   runs are reproducible. With 0 each hart gets its own host thread */
+void harts_run(Processor *harts, int count, Word quantum, int prompt, int print);
+
+#endif
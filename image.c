@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "image.h"
+#include "riscv.h"
+#include "predecode.h"
+
+
+/* Program images shared between runs. The first run of a program loads
+   it into a file in the cache directory, named for a hash of the .input
+   file, with its memory, predecoded records, basic blocks and fused pairs
+   laid out as the simulator uses them. Every run, that one included, then
+   maps the file MAP_PRIVATE: the pages stay shared in the page cache until
+   a run writes one and gets its own copy, and a warm start decodes
+   nothing. The profile at the end is mapped MAP_SHARED so that what each
+   run counts adds up across runs, see predecode.c.
+
+   The layout below is part of the hash through MAGIC: change one, change
+   the other, and old files are simply never looked at again */
+
+typedef struct {
+  Word magic;
+  Word size;
+} Header;
+
+#define MAGIC 0x52564933 // "RVI3"
+
+/* The header gets a page to itself so that memory is page aligned, and
+   the rest are multiples of the page size */
+#define MEMORY_OFFSET PAGE_SIZE
+#define RECORDS_OFFSET (MEMORY_OFFSET + MEMORY_SPACE)
+#define FUSED_OFFSET (RECORDS_OFFSET + CODE_SLOTS * sizeof(Decoded))
+#define PROFILE_OFFSET (FUSED_OFFSET + CODE_SLOTS)
+#define FILE_SIZE (PROFILE_OFFSET + CODE_SLOTS * sizeof(Double))
+
+
+static Double mix(Double h, const void *data, size_t length) {
+  size_t i;
+  for (i = 0; i < length; i++) h = (h ^ ((const Byte *) data)[i]) * 0x100000001b3ULL;
+  return h;
+}
+
+
+/* FNV-1a of the file, and of what else decides the image's contents:
+   the records hold Op and CompressedOp values, so the instruction list
+   is part of it, as aot_op_count is for translations */
+static int hash_file(const char *filename, Address base, Double *hash) {
+  Byte buffer[65536];
+  size_t length;
+  Double h = 0xcbf29ce484222325ULL;
+  Word salt[] = { MAGIC, base, sizeof(Decoded), OP_COUNT, COMPRESSED_COUNT };
+  FILE *file = fopen(filename, "rb");
+  int i;
+
+  if (file == NULL) return 0;
+  h = mix(h, salt, sizeof(salt));
+  for (i = 0; i < OP_COUNT; i++) {
+    h = mix(h, instruction_specs[i].name, strlen(instruction_specs[i].name) + 1);
+    h = mix(h, &instruction_specs[i].match, sizeof(Word));
+    h = mix(h, &instruction_specs[i].mask, sizeof(Word));
+  }
+  for (i = 0; i < COMPRESSED_COUNT; i++) {
+    h = mix(h, compressed_specs[i].name, strlen(compressed_specs[i].name) + 1);
+  }
+  while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) h = mix(h, buffer, length);
+  fclose(file);
+  *hash = h;
+  return 1;
+}
+
+
+/* Writes the image to a file of its own and moves it into place, so
+   other runs see either nothing or all of it */
+static int create(const char *path, const char *filename, Address base) {
+  char temporary[4096 + 16];
+  Byte *contents;
+  Header *header;
+  int fd;
+
+  snprintf(temporary, sizeof(temporary), "%s.%d", path, (int) getpid());
+  if ((fd = open(temporary, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) return 0;
+  if (ftruncate(fd, FILE_SIZE) != 0 ||
+      (contents = mmap(NULL, FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+    close(fd);
+    unlink(temporary);
+    return 0;
+  }
+  close(fd);
+
+  header = (Header *) contents;
+  header->size = load_program(contents + MEMORY_OFFSET, MEMORY_SPACE, base, filename, 0);
+  predecode_prepare((Decoded *) (contents + RECORDS_OFFSET), contents + FUSED_OFFSET,
+                    contents + MEMORY_OFFSET, base, header->size);
+  header->magic = MAGIC;
+  munmap(contents, FILE_SIZE);
+
+  if (rename(temporary, path) != 0) {
+    unlink(temporary);
+    return 0;
+  }
+  return 1;
+}
+
+
+int image_map(Image *image, const char *filename, Address base, const char *directory) {
+  char path[4096];
+  Byte *contents, *profile;
+  struct stat status;
+  Double hash;
+  int fd;
+
+  if (!hash_file(filename, base, &hash)) return 0;
+  snprintf(path, sizeof(path), "%s/riscv-image-%016llx", directory, (unsigned long long) hash);
+
+  if ((fd = open(path, O_RDWR)) < 0) {
+    if (!create(path, filename, base) || (fd = open(path, O_RDWR)) < 0) return 0;
+  }
+  if (fstat(fd, &status) != 0 || status.st_size != FILE_SIZE) {
+    close(fd);
+    return 0;
+  }
+  contents = mmap(NULL, PROFILE_OFFSET, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  profile = mmap(NULL, FILE_SIZE - PROFILE_OFFSET, PROT_READ | PROT_WRITE, MAP_SHARED, fd, PROFILE_OFFSET);
+  close(fd);
+  if (contents == MAP_FAILED || profile == MAP_FAILED || ((Header *) contents)->magic != MAGIC) {
+    if (contents != MAP_FAILED) munmap(contents, PROFILE_OFFSET);
+    if (profile != MAP_FAILED) munmap(profile, FILE_SIZE - PROFILE_OFFSET);
+    return 0;
+  }
+
+  image->memory = contents + MEMORY_OFFSET;
+  image->records = (Decoded *) (contents + RECORDS_OFFSET);
+  image->fused = contents + FUSED_OFFSET;
+  image->profile = (Double *) profile;
+  image->base = base;
+  image->size = ((Header *) contents)->size;
+  return 1;
+}
+
+
+static const Double *sort_profile;
+
+static int hotter(const void *a, const void *b) {
+  Double x = sort_profile[*(const Word *) a], y = sort_profile[*(const Word *) b];
+  return x < y ? 1 : x > y ? -1 : 0;
+}
+
+
+void image_print_profile(const Image *image, FILE *out, int count) {
+  Word *blocks = malloc(CODE_SLOTS * sizeof(Word));
+  Word slot, found = 0;
+  Double total = 0;
+  int i;
+
+  for (slot = 0; slot < CODE_SLOTS; slot++) {
+    if (image->profile[slot]) {
+      blocks[found++] = slot;
+      total += image->profile[slot];
+    }
+  }
+  sort_profile = image->profile;
+  qsort(blocks, found, sizeof(Word), hotter);
+
+  fprintf(out, "%u blocks run %llu times in all\n", found, (unsigned long long) total);
+  for (i = 0; i < count && i < (int) found; i++) {
+    fprintf(out, "%08x %12llu %5.1f%%\n", blocks[i] << 1, (unsigned long long) image->profile[blocks[i]],
+            100.0 * image->profile[blocks[i]] / total);
+  }
+  free(blocks);
+}
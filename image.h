@@ -0,0 +1,33 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "types.h"
+#include "isa.h"
+
+/* Where loaded images are kept for other runs of the same program,
+   unless -K names a directory that outlives a reboot */
+#define IMAGE_CACHE_DIR "/dev/shm"
+
+/* A program loaded at base, mapped copy-on-write from a file shared by
+   every run of it. Only the pages a run writes are its own. The profile
+   alone is written through to the file, by every run */
+typedef struct {
+  Byte *memory;     // MEMORY_SPACE bytes
+  Decoded *records; // one per halfword of memory, see predecode_prepare()
+  Byte *fused;      // one per halfword, basic block leaders and fused pairs
+  Double *profile;  // one per halfword, how often each block ran in all runs
+  Address base;
+  size_t size;      // bytes of the program
+} Image;
+
+/* Maps the image of filename from the cache in directory, loading it
+   into the cache first if no run has yet. Returns 0 if there is no
+   cache to use, and the caller loads the program itself */
+int image_map(Image *, const char *filename, Address base, const char *directory);
+
+/* Lists the hottest blocks in the profile, most run first */
+void image_print_profile(const Image *, FILE *, int count);
+
+#endif
@@ -0,0 +1,230 @@
+#include "isa.h"
+#include "utils.h"
+
+
+/* The decoder is a single lookup keyed on opcode[6:2], funct3 and funct7,
+   with opcode in the high bits. Every instruction's don't-care key bits
+   are then a run of low bits, so each one owns one contiguous range of
+   keys and the whole table is built by the compiler from the spec */
+#define DECODE_KEY_BITS 15
+#define DECODE_KEY(w) ((((w) >> 2) & 0x1F) << 10 | (((w) >> 12) & 0x7) << 7 | (((w) >> 25) & 0x7F))
+#define DECODE_DONT_CARE(mask) (~DECODE_KEY(mask) & ((1 << DECODE_KEY_BITS) - 1))
+
+#define CHECK_RANGE(name, format, match, mask) \
+  _Static_assert((DECODE_DONT_CARE(mask) & (DECODE_DONT_CARE(mask) + 1)) == 0, \
+                 #name " needs a key bit that is below one it ignores");
+INSTRUCTIONS(CHECK_RANGE)
+#undef CHECK_RANGE
+
+#define DECODE_RANGE(name, format, match, mask) \
+  [DECODE_KEY(match) ... DECODE_KEY(match) | DECODE_DONT_CARE(mask)] = OP_##name,
+static const Byte decode_table[1 << DECODE_KEY_BITS] = {
+  INSTRUCTIONS(DECODE_RANGE)
+};
+#undef DECODE_RANGE
+
+#define SPEC(name, format, match, mask) [OP_##name] = { #name, format, match, mask },
+const InstructionSpec instruction_specs[OP_COUNT] = {
+  [OP_invalid] = { "invalid", FORMAT_INVALID, 0, 0 },
+  INSTRUCTIONS(SPEC)
+};
+#undef SPEC
+
+#define COMPRESSED_SPEC(name, format) [COMPRESSED_##name] = { #name, format },
+const CompressedSpec compressed_specs[COMPRESSED_COUNT] = {
+  [COMPRESSED_none] = { "invalid", FORMAT_INVALID },
+  COMPRESSED(COMPRESSED_SPEC)
+};
+#undef COMPRESSED_SPEC
+
+
+/* Fields of the compressed formats. The primed registers of CIW, CL, CS,
+   CA and CB are 3 bits wide and name x8 to x15 */
+#define C_RD(h) (((h) >> 7) & 0x1F)
+#define C_RS2(h) (((h) >> 2) & 0x1F)
+#define C_RD_PRIME(h) (8 + (((h) >> 2) & 7))
+#define C_RS1_PRIME(h) (8 + (((h) >> 7) & 7))
+
+/* The immediates, scattered differently by each format */
+static inline sWord imm_ci(Word h) {
+  return sign_extend((h >> 7 & 0x20) | (h >> 2 & 0x1F), 6);
+}
+
+static inline Word imm_ciw(Word h) {
+  return (h >> 7 & 0x30) | (h >> 1 & 0x3C0) | (h >> 4 & 0x4) | (h >> 2 & 0x8);
+}
+
+static inline Word imm_cl(Word h) {
+  return (h >> 7 & 0x38) | (h >> 4 & 0x4) | (h << 1 & 0x40);
+}
+
+static inline sWord imm_addi16sp(Word h) {
+  return sign_extend((h >> 3 & 0x200) | (h >> 2 & 0x10) | (h << 1 & 0x40) | (h << 4 & 0x180) | (h << 3 & 0x20), 10);
+}
+
+static inline sWord imm_cj(Word h) {
+  return sign_extend((h >> 1 & 0x800) | (h >> 7 & 0x10) | (h >> 1 & 0x300) | (h << 2 & 0x400)
+                     | (h >> 1 & 0x40) | (h << 1 & 0x80) | (h >> 2 & 0xE) | (h << 3 & 0x20), 12);
+}
+
+static inline sWord imm_cb(Word h) {
+  return sign_extend((h >> 4 & 0x100) | (h >> 7 & 0x18) | (h << 1 & 0xC0) | (h >> 2 & 0x6) | (h << 3 & 0x20), 9);
+}
+
+static inline Word imm_lwsp(Word h) {
+  return (h >> 7 & 0x20) | (h >> 2 & 0x1C) | (h << 4 & 0xC0);
+}
+
+static inline Word imm_swsp(Word h) {
+  return (h >> 7 & 0x3C) | (h >> 1 & 0xC0);
+}
+
+
+/* Fills decoded with what the 16-bit instruction h expands to. Reserved
+   encodings, and those of the F and D extensions, decode as invalid */
+static void decode_compressed(Word h, Decoded *d) {
+  CompressedOp c = COMPRESSED_none;
+  Byte op = OP_invalid, rd = 0, rs1 = 0, rs2 = 0;
+  sWord imm = 0;
+
+  switch ((h & 3) << 3 | h >> 13) {
+    case 000:
+      rd = C_RD_PRIME(h), rs1 = 2, imm = imm_ciw(h);
+      if (imm) c = COMPRESSED_c_addi4spn, op = OP_addi;
+      break;
+    case 002:
+      c = COMPRESSED_c_lw, op = OP_lw, rd = C_RD_PRIME(h), rs1 = C_RS1_PRIME(h), imm = imm_cl(h);
+      break;
+    case 006:
+      c = COMPRESSED_c_sw, op = OP_sw, rs2 = C_RD_PRIME(h), rs1 = C_RS1_PRIME(h), imm = imm_cl(h);
+      break;
+    case 010:
+      c = C_RD(h) ? COMPRESSED_c_addi : COMPRESSED_c_nop, op = OP_addi, rd = rs1 = C_RD(h), imm = imm_ci(h);
+      break;
+    case 011:
+      c = COMPRESSED_c_jal, op = OP_jal, rd = 1, imm = imm_cj(h);
+      break;
+    case 012:
+      c = COMPRESSED_c_li, op = OP_addi, rd = C_RD(h), imm = imm_ci(h);
+      break;
+    case 013:
+      rd = C_RD(h);
+      if (rd == 2) {
+        rs1 = 2, imm = imm_addi16sp(h);
+        if (imm) c = COMPRESSED_c_addi16sp, op = OP_addi;
+      } else {
+        imm = imm_ci(h) << 12;
+        if (imm) c = COMPRESSED_c_lui, op = OP_lui;
+      }
+      break;
+    case 014:
+      rd = rs1 = C_RS1_PRIME(h), rs2 = C_RD_PRIME(h);
+      switch (h >> 10 & 3) {
+        case 0:
+          if (!(h & 0x1000)) c = COMPRESSED_c_srli, op = OP_srli, imm = C_RS2(h);
+          break;
+        case 1:
+          if (!(h & 0x1000)) c = COMPRESSED_c_srai, op = OP_srai, imm = C_RS2(h);
+          break;
+        case 2:
+          c = COMPRESSED_c_andi, op = OP_andi, imm = imm_ci(h);
+          break;
+        case 3: {
+          static const Byte ops[4] = { OP_sub, OP_xor, OP_or, OP_and };
+          if (!(h & 0x1000)) c = COMPRESSED_c_sub + (h >> 5 & 3), op = ops[h >> 5 & 3];
+          break;
+        }
+      }
+      break;
+    case 015:
+      c = COMPRESSED_c_j, op = OP_jal, imm = imm_cj(h);
+      break;
+    case 016:
+    case 017:
+      c = h & 0x2000 ? COMPRESSED_c_bnez : COMPRESSED_c_beqz, op = h & 0x2000 ? OP_bne : OP_beq;
+      rs1 = C_RS1_PRIME(h), imm = imm_cb(h);
+      break;
+    case 020:
+      rd = rs1 = C_RD(h), imm = C_RS2(h);
+      if (!(h & 0x1000)) c = COMPRESSED_c_slli, op = OP_slli;
+      break;
+    case 022:
+      rd = C_RD(h), rs1 = 2, imm = imm_lwsp(h);
+      if (rd) c = COMPRESSED_c_lwsp, op = OP_lw;
+      break;
+    case 024:
+      if (!(h & 0x1000)) {
+        if (C_RS2(h)) c = COMPRESSED_c_mv, op = OP_add, rd = C_RD(h), rs2 = C_RS2(h);
+        else if (C_RD(h)) c = COMPRESSED_c_jr, op = OP_jalr, rs1 = C_RD(h);
+      } else if (C_RS2(h)) {
+        c = COMPRESSED_c_add, op = OP_add, rd = rs1 = C_RD(h), rs2 = C_RS2(h);
+      } else if (C_RD(h)) {
+        // c.ebreak, with rd 0, is not implemented
+        c = COMPRESSED_c_jalr, op = OP_jalr, rd = 1, rs1 = C_RD(h);
+      }
+      break;
+    case 026:
+      c = COMPRESSED_c_swsp, op = OP_sw, rs1 = 2, rs2 = C_RS2(h), imm = imm_swsp(h);
+      break;
+  }
+
+  d->bits = h;
+  d->op = op;
+  d->rd = rd;
+  d->rs1 = rs1;
+  d->rs2 = rs2;
+  d->length = 2;
+  d->compressed = c;
+  d->imm = imm;
+}
+
+
+void decode(Instruction instruction, Decoded *decoded) {
+  Byte op;
+
+  if (is_compressed(instruction.bits)) {
+    decode_compressed(instruction.bits & 0xFFFF, decoded);
+    return;
+  }
+  op = decode_table[DECODE_KEY(instruction.bits)];
+
+  // the key does not cover every fixed bit, e.g. opcode[1:0] or shamt[5]
+  if ((instruction.bits & instruction_specs[op].mask) != instruction_specs[op].match) op = OP_invalid;
+
+  decoded->bits = instruction.bits;
+  decoded->op = op;
+  decoded->rd = instruction.rtype.rd;
+  decoded->rs1 = instruction.rtype.rs1;
+  decoded->rs2 = instruction.rtype.rs2;
+  decoded->length = 4;
+  decoded->compressed = COMPRESSED_none;
+
+  switch (instruction_specs[op].format) {
+    case FORMAT_I:
+    case FORMAT_LOAD:
+      decoded->imm = imm_i(instruction.bits);
+      break;
+    case FORMAT_SHIFT:
+      decoded->imm = instruction.itype.imm & 31;
+      break;
+    case FORMAT_S:
+      decoded->imm = imm_s(instruction.bits);
+      break;
+    case FORMAT_B:
+      decoded->imm = imm_b(instruction.bits);
+      break;
+    case FORMAT_U:
+      decoded->imm = imm_u(instruction.bits);
+      break;
+    case FORMAT_J:
+      decoded->imm = imm_j(instruction.bits);
+      break;
+    case FORMAT_CSR:
+    case FORMAT_CSRI:
+      decoded->imm = instruction.bits >> 20;
+      break;
+    default:
+      decoded->imm = 0;
+      break;
+  }
+}
@@ -0,0 +1,173 @@
+#ifndef ISA_H
+#define ISA_H
+
+#include "types.h"
+
+/* The single description of every instruction the simulator knows.
+   The decoder table, the disassembler and the execute dispatch in part2.c
+   are all generated from this list, so adding an instruction means adding
+   a line here and an exec_<name>() handler in part2.c.
+
+   X(name, format, match, mask): an instruction word w is <name> when
+   (w & mask) == match. The format picks the operand extractor in isa.c
+   and the disassembly layout in part1.c. An underscore in name is a dot
+   in the mnemonic, so lr_w disassembles as lr.w. */
+#define INSTRUCTIONS(X) \
+  X(lui,    FORMAT_U,     0x00000037, 0x0000007f) \
+  X(auipc,  FORMAT_U,     0x00000017, 0x0000007f) \
+  X(jal,    FORMAT_J,     0x0000006f, 0x0000007f) \
+  X(jalr,   FORMAT_I,     0x00000067, 0x0000707f) \
+  X(beq,    FORMAT_B,     0x00000063, 0x0000707f) \
+  X(bne,    FORMAT_B,     0x00001063, 0x0000707f) \
+  X(lb,     FORMAT_LOAD,  0x00000003, 0x0000707f) \
+  X(lh,     FORMAT_LOAD,  0x00001003, 0x0000707f) \
+  X(lw,     FORMAT_LOAD,  0x00002003, 0x0000707f) \
+  X(sb,     FORMAT_S,     0x00000023, 0x0000707f) \
+  X(sh,     FORMAT_S,     0x00001023, 0x0000707f) \
+  X(sw,     FORMAT_S,     0x00002023, 0x0000707f) \
+  X(addi,   FORMAT_I,     0x00000013, 0x0000707f) \
+  X(slti,   FORMAT_I,     0x00002013, 0x0000707f) \
+  X(xori,   FORMAT_I,     0x00004013, 0x0000707f) \
+  X(ori,    FORMAT_I,     0x00006013, 0x0000707f) \
+  X(andi,   FORMAT_I,     0x00007013, 0x0000707f) \
+  X(slli,   FORMAT_SHIFT, 0x00001013, 0xfe00707f) \
+  X(srli,   FORMAT_SHIFT, 0x00005013, 0xfe00707f) \
+  X(srai,   FORMAT_SHIFT, 0x40005013, 0xfe00707f) \
+  X(add,    FORMAT_R,     0x00000033, 0xfe00707f) \
+  X(sub,    FORMAT_R,     0x40000033, 0xfe00707f) \
+  X(sll,    FORMAT_R,     0x00001033, 0xfe00707f) \
+  X(slt,    FORMAT_R,     0x00002033, 0xfe00707f) \
+  X(xor,    FORMAT_R,     0x00004033, 0xfe00707f) \
+  X(srl,    FORMAT_R,     0x00005033, 0xfe00707f) \
+  X(sra,    FORMAT_R,     0x40005033, 0xfe00707f) \
+  X(or,     FORMAT_R,     0x00006033, 0xfe00707f) \
+  X(and,    FORMAT_R,     0x00007033, 0xfe00707f) \
+  X(mul,    FORMAT_R,     0x02000033, 0xfe00707f) \
+  X(mulh,   FORMAT_R,     0x02001033, 0xfe00707f) \
+  X(div,    FORMAT_R,     0x02004033, 0xfe00707f) \
+  X(rem,    FORMAT_R,     0x02006033, 0xfe00707f) \
+  X(ecall,  FORMAT_NONE,  0x00000073, 0xffffffff) \
+  X(csrrw,  FORMAT_CSR,   0x00001073, 0x0000707f) \
+  X(csrrs,  FORMAT_CSR,   0x00002073, 0x0000707f) \
+  X(csrrc,  FORMAT_CSR,   0x00003073, 0x0000707f) \
+  X(csrrwi, FORMAT_CSRI,  0x00005073, 0x0000707f) \
+  X(csrrsi, FORMAT_CSRI,  0x00006073, 0x0000707f) \
+  X(csrrci, FORMAT_CSRI,  0x00007073, 0x0000707f) \
+  X(lr_w,      FORMAT_LR,  0x1000202f, 0xf9f0707f) \
+  X(sc_w,      FORMAT_AMO, 0x1800202f, 0xf800707f) \
+  X(amoswap_w, FORMAT_AMO, 0x0800202f, 0xf800707f) \
+  X(amoadd_w,  FORMAT_AMO, 0x0000202f, 0xf800707f) \
+  X(amoxor_w,  FORMAT_AMO, 0x2000202f, 0xf800707f) \
+  X(amoand_w,  FORMAT_AMO, 0x6000202f, 0xf800707f) \
+  X(amoor_w,   FORMAT_AMO, 0x4000202f, 0xf800707f) \
+  X(amomin_w,  FORMAT_AMO, 0x8000202f, 0xf800707f) \
+  X(amomax_w,  FORMAT_AMO, 0xa000202f, 0xf800707f) \
+  X(amominu_w, FORMAT_AMO, 0xc000202f, 0xf800707f) \
+  X(amomaxu_w, FORMAT_AMO, 0xe000202f, 0xf800707f)
+
+/* The C extension: 16-bit instructions, any halfword whose low two bits
+   are not 11. Each one is decoded straight into the instruction above it
+   expands to, so the same exec_<name>() runs it and only the length and
+   the disassembly differ. The expansions are in decode_compressed() in
+   isa.c; X(name, format) gives the layout of the short form's operands */
+#define COMPRESSED(X) \
+  X(c_addi4spn, FORMAT_I)    /* addi rd', x2, nzuimm */ \
+  X(c_lw,       FORMAT_LOAD) \
+  X(c_sw,       FORMAT_S) \
+  X(c_nop,      FORMAT_NONE) \
+  X(c_addi,     FORMAT_CI) \
+  X(c_jal,      FORMAT_CJ)   /* jal x1, offset */ \
+  X(c_li,       FORMAT_CI)   /* addi rd, x0, imm */ \
+  X(c_addi16sp, FORMAT_CI) \
+  X(c_lui,      FORMAT_CI) \
+  X(c_srli,     FORMAT_CI) \
+  X(c_srai,     FORMAT_CI) \
+  X(c_andi,     FORMAT_CI) \
+  X(c_sub,      FORMAT_CR) \
+  X(c_xor,      FORMAT_CR) \
+  X(c_or,       FORMAT_CR) \
+  X(c_and,      FORMAT_CR) \
+  X(c_j,        FORMAT_CJ)   /* jal x0, offset */ \
+  X(c_beqz,     FORMAT_CB)   /* beq rs1', x0, offset */ \
+  X(c_bnez,     FORMAT_CB) \
+  X(c_slli,     FORMAT_CI) \
+  X(c_lwsp,     FORMAT_LOAD) \
+  X(c_jr,       FORMAT_CJR)  /* jalr x0, 0(rs1) */ \
+  X(c_mv,       FORMAT_CR)   /* add rd, x0, rs2 */ \
+  X(c_jalr,     FORMAT_CJR)  /* jalr x1, 0(rs1) */ \
+  X(c_add,      FORMAT_CR) \
+  X(c_swsp,     FORMAT_S)
+
+/* Operand layouts. Each has its own immediate encoding in the word and
+   its own disassembly layout from utils.h */
+typedef enum {
+  FORMAT_INVALID,
+  FORMAT_R,     // rd, rs1, rs2
+  FORMAT_I,     // rd, rs1, sign-extended imm[11:0]
+  FORMAT_SHIFT, // rd, rs1, shamt
+  FORMAT_LOAD,  // rd, imm[11:0](rs1)
+  FORMAT_S,     // rs2, imm[11:0](rs1)
+  FORMAT_B,     // rs1, rs2, branch offset
+  FORMAT_U,     // rd, imm[31:12] already shifted into place
+  FORMAT_J,     // rd, jump offset
+  FORMAT_CSR,   // rd, csr in imm, rs1
+  FORMAT_CSRI,  // rd, csr in imm, 5-bit immediate in rs1
+  FORMAT_LR,    // rd, (rs1)
+  FORMAT_AMO,   // rd, rs2, (rs1), ignoring the aq/rl ordering bits
+  FORMAT_NONE,
+  FORMAT_CI,    // compressed: rd, imm, or imm[31:12] for c.lui
+  FORMAT_CR,    // compressed: rd, rs2
+  FORMAT_CJR,   // compressed: rs1
+  FORMAT_CB,    // compressed: rs1, branch offset
+  FORMAT_CJ,    // compressed: jump offset
+} Format;
+
+#define ISA_OP(name, format, match, mask) OP_##name,
+typedef enum {
+  OP_invalid,
+  INSTRUCTIONS(ISA_OP)
+  OP_COUNT
+} Op;
+#undef ISA_OP
+
+#define ISA_COMPRESSED(name, format) COMPRESSED_##name,
+typedef enum {
+  COMPRESSED_none,
+  COMPRESSED(ISA_COMPRESSED)
+  COMPRESSED_COUNT
+} CompressedOp;
+#undef ISA_COMPRESSED
+
+/* An instruction with its operands pulled out of the encoding */
+typedef struct {
+  Word bits;        // the halfword alone for a compressed instruction
+  Byte op;
+  Byte rd, rs1, rs2;
+  Byte length;      // in bytes, 2 or 4
+  Byte compressed;  // the CompressedOp it was written as, or COMPRESSED_none
+  sWord imm;
+} Decoded;
+
+typedef struct {
+  const char *name;
+  Format format;
+  Word match, mask;
+} InstructionSpec;
+
+extern const InstructionSpec instruction_specs[OP_COUNT];
+
+typedef struct {
+  const char *name;
+  Format format;
+} CompressedSpec;
+
+extern const CompressedSpec compressed_specs[COMPRESSED_COUNT];
+
+/* Whether an instruction starting with the halfword is a 16-bit one */
+static inline int is_compressed(Word bits) {
+  return (bits & 3) != 3;
+}
+
+void decode(Instruction, Decoded *);
+
+#endif
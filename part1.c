@@ -2,308 +2,266 @@
 #include <stdlib.h> // for exit()
 #include "types.h"
 #include "utils.h"
+#include "riscv.h"
+#include "isa.h"
+#include "csr.h"
 
 
 // forward declarations
-void print_rtype(char *, Instruction);
-void print_itype_except_load(char *, Instruction, int);
-void print_load(char *, Instruction);
-void print_store(char *, Instruction);
-void print_branch(char *, Instruction);
-void write_rtype(Instruction);
-void write_itype_except_load(Instruction);
-void write_load(Instruction);
-void write_store(Instruction);
-void write_branch(Instruction);
-void write_auipc(Instruction);
-void write_lui(Instruction);
-void write_jalr(Instruction);
-void write_jal(Instruction);
-void write_ecall(Instruction);
+char *print_rtype(char *, const char *, const Decoded *);
+char *print_itype(char *, const char *, const Decoded *);
+char *print_load(char *, const char *, const Decoded *);
+char *print_store(char *, const char *, const Decoded *);
+char *print_branch(char *, const char *, const Decoded *);
+char *print_utype(char *, const char *, const Decoded *);
+char *print_jal(char *, const char *, const Decoded *);
+char *print_csr(char *, const char *, const Decoded *);
+char *print_lr(char *, const char *, const Decoded *);
+char *print_amo(char *, const char *, const Decoded *);
+char *print_invalid(char *, const Decoded *);
+static char *print_compressed(char *, const Decoded *);
 
 
-void decode_instruction(Instruction instruction) {
-    switch(instruction.opcode) {
-        case 0b0110011: // R-type
-            write_rtype(instruction);
-            break;
-        case 0b0010011: // I-type except load
-            write_itype_except_load(instruction);
-            break;
-        case 0b0000011: // Load
-            write_load(instruction);
-            break;
-        case 0b0100011: // Store
-            write_store(instruction);
-            break;
-        case 0b1100011: // Branch
-            write_branch(instruction);
-            break;
-        case 0b0010111: // AUIPC
-            write_auipc(instruction);
-            break;
-        case 0b0110111: // LUI
-            write_lui(instruction);
-            break;
-        case 0b1100111: // JALR
-            write_jalr(instruction);
-            break;
-        case 0b1101111: // JAL
-            write_jal(instruction);
-            break;
-        case 0b1110011: // ECALL
-            write_ecall(instruction);
-            break;
-        default:
-            handle_invalid_instruction(instruction);
-            break;
-    }
+/* Spec names spell the dots in mnemonics as underscores, see isa.h */
+static char *format_mnemonic(char *out, const char *name) {
+    for (; *name; name++) *out++ = *name == '_' ? '.' : *name;
+    return out;
 }
 
 
-void write_rtype(Instruction instruction) {
-    
-    switch(instruction.rtype.funct3) {
-        case 0x0:
-	       switch(instruction.rtype.funct7) {
-	          case 0x0:
-	            print_rtype("add", instruction);
-	            break;
-	          case 0x01:
-	            print_rtype("mul", instruction);
-	            break;
-	          case 0x20:
-	            print_rtype("sub", instruction);
-	            break;
-              default:            
-                handle_invalid_instruction(instruction);
-                break;
-           }
-           break; 
-       case 0x1:
-	       switch(instruction.rtype.funct7) {
-	           case 0x0:
-	            print_rtype("sll", instruction);
-	            break;
-	           case 0x1:
-	            print_rtype("mulh", instruction);
-	            break;
-              default:            
-                handle_invalid_instruction(instruction);
-                break;
-	   }
-       break;        
-	case 0x2:
-	       switch(instruction.rtype.funct7) {
-	           case 0x0:
-	            print_rtype("slt", instruction);
-	            break;
-              default:            
-                handle_invalid_instruction(instruction);
-                break;
-	   }
-       break;       
-	case 0x4:
-	       switch(instruction.rtype.funct7) {
-	           case 0x0:
-	            print_rtype("xor", instruction);
-	            break;
-	           case 0x1:
-	            print_rtype("div", instruction);
-	            break;
-              default:            
-                handle_invalid_instruction(instruction);
-                break;
-	    }        
-       break;        
-	case 0x5:
-	       switch(instruction.rtype.funct7) {
-	           case 0x0:
-	            print_rtype("srl", instruction);
-	            break;
-	           case 0x20:
-	            print_rtype("sra", instruction);
-	            break;
-              default:            
-                handle_invalid_instruction(instruction);
-                break;
-	   }     
-       break;       
-	case 0x6:
-	       switch(instruction.rtype.funct7) {      
-	           case 0x0:
-	            print_rtype("or", instruction);
-	            break;
-	           case 0x1:
-	            print_rtype("rem", instruction);
-	            break;
-              default:            
-                handle_invalid_instruction(instruction);
-                break;
-	   }         
-       break;        
-	case 0x7:
-	       switch(instruction.rtype.funct7) {       
-	           case 0x0:
-	            print_rtype("and", instruction);
-	            break;
-              default:            
-                handle_invalid_instruction(instruction);
-                break;
-	    }
-       break;       
-    default:            
-            handle_invalid_instruction(instruction);
-            break;
-   }
-}
-
-void write_itype_except_load(Instruction instruction) {
-    
-    switch(instruction.itype.funct3) {
-        case 0x0:
-            print_itype_except_load("addi", instruction, instruction.itype.imm);
-            break;
-        case 0x1:
-            print_itype_except_load("slli", instruction, instruction.itype.imm);
-            break;
-        case 0x2:
-            print_itype_except_load("slti", instruction, instruction.itype.imm);
-            break;
-        case 0x4:
-            print_itype_except_load("xori", instruction, instruction.itype.imm);
-            break;          
-        case 0x6:
-            print_itype_except_load("ori", instruction, instruction.itype.imm);
-            break;  
-        case 0x7:
-            print_itype_except_load("andi", instruction, instruction.itype.imm);
-            break;  
-        case 0x5:
-	     switch(instruction.itype.imm >> 5){  
-            case 0x20:     
-                print_itype_except_load("srai",instruction,instruction.itype.imm & 31); 
-	            break;      
-            case 0x0:
-	            print_itype_except_load("srli",instruction,instruction.itype.imm & 31);
-	            break;  
-          }
-            break;
-        default:            
-            handle_invalid_instruction(instruction);
-            break;
-    }
+void decode_instruction(Instruction instruction) {
+    char line[DISASM_MAX_LINE];
+    fwrite(line, 1, disassemble(line, instruction) - line, stdout);
 }
 
 
-void write_load(Instruction instruction) {
-    
-    switch(instruction.itype.funct3) {
-        case 0x0:
-            print_load("lb", instruction);
-            break;
-        case 0x1:
-            print_load("lh", instruction);
-            break;
-        case 0x2:
-            print_load("lw", instruction);
-            break;
-        default:            
-            handle_invalid_instruction(instruction);
-            break;
-    }
+/* Writes the disassembly of instruction at out, in the layouts given in
+   utils.h. Returns a pointer past the last character written */
+char *disassemble(char *out, Instruction instruction) {
+    Decoded decoded;
+    decode(instruction, &decoded);
+    return disassemble_decoded(out, &decoded);
 }
 
 
-void write_store(Instruction instruction) {
-    
-    switch(instruction.stype.funct3) {
-        case 0x0:
-            print_store("sb", instruction);
-            break;
-        case 0x1:
-            print_store("sh", instruction);
-            break;
-        case 0x2:
-            print_store("sw", instruction);
-            break;
+char *disassemble_decoded(char *out, const Decoded *decoded) {
+    const char *name = instruction_specs[decoded->op].name;
+
+    if (decoded->compressed) return print_compressed(out, decoded);
+    switch (instruction_specs[decoded->op].format) {
+        case FORMAT_R:
+            return print_rtype(out, name, decoded);
+        case FORMAT_I:
+        case FORMAT_SHIFT:
+            return print_itype(out, name, decoded);
+        case FORMAT_LOAD:
+            return print_load(out, name, decoded);
+        case FORMAT_S:
+            return print_store(out, name, decoded);
+        case FORMAT_B:
+            return print_branch(out, name, decoded);
+        case FORMAT_U:
+            return print_utype(out, name, decoded);
+        case FORMAT_J:
+            return print_jal(out, name, decoded);
+        case FORMAT_CSR:
+        case FORMAT_CSRI:
+            return print_csr(out, name, decoded);
+        case FORMAT_LR:
+            return print_lr(out, name, decoded);
+        case FORMAT_AMO:
+            return print_amo(out, name, decoded);
+        case FORMAT_NONE:
+            out = format_mnemonic(out, name);
+            *out++ = '\n';
+            return out;
         default:
-            handle_invalid_instruction(instruction);
-            break;
+            return print_invalid(out, decoded);
     }
 }
 
 
-void write_branch(Instruction instruction) {
-    
-    switch(instruction.btype.funct3) {
-        case 0x0:
-            print_branch("beq", instruction);
-            break;
-        case 0x1:
-            print_branch("bne", instruction);
-            break;
-        default:            
-            handle_invalid_instruction(instruction);
-            break;
-    }
+char *print_rtype(char *out, const char *name, const Decoded *decoded) {
+    out = format_mnemonic(out, name);
+    *out++ = '\t';
+    out = format_reg(out, decoded->rd);
+    out = format_str(out, ", ");
+    out = format_reg(out, decoded->rs1);
+    out = format_str(out, ", ");
+    out = format_reg(out, decoded->rs2);
+    *out++ = '\n';
+    return out;
 }
 
 
-/* For the writes, probably a good idea to take a look at utils.h */
+char *print_itype(char *out, const char *name, const Decoded *decoded) {
+    out = format_mnemonic(out, name);
+    *out++ = '\t';
+    out = format_reg(out, decoded->rd);
+    out = format_str(out, ", ");
+    out = format_reg(out, decoded->rs1);
+    out = format_str(out, ", ");
+    out = format_int(out, decoded->imm);
+    *out++ = '\n';
+    return out;
+}
+
 
-void write_auipc(Instruction instruction) {
-  /* YOUR CODE HERE */
-   printf(AUIPC_FORMAT, instruction.utype.rd, instruction.utype.imm);
+char *print_load(char *out, const char *name, const Decoded *decoded) {
+    out = format_mnemonic(out, name);
+    *out++ = '\t';
+    out = format_reg(out, decoded->rd);
+    out = format_str(out, ", ");
+    out = format_int(out, decoded->imm);
+    *out++ = '(';
+    out = format_reg(out, decoded->rs1);
+    out = format_str(out, ")\n");
+    return out;
 }
 
 
-void write_lui(Instruction instruction) {
-  /* YOUR CODE HERE */
-    printf(LUI_FORMAT, instruction.utype.rd, instruction.utype.imm);
+char *print_store(char *out, const char *name, const Decoded *decoded) {
+    out = format_mnemonic(out, name);
+    *out++ = '\t';
+    out = format_reg(out, decoded->rs2);
+    out = format_str(out, ", ");
+    out = format_int(out, decoded->imm);
+    *out++ = '(';
+    out = format_reg(out, decoded->rs1);
+    out = format_str(out, ")\n");
+    return out;
 }
 
 
-void write_jalr(Instruction instruction) {
-  /* YOUR CODE HERE */
-    printf(JALR_FORMAT, instruction.itype.rd, instruction.itype.rs1, bitExtender(instruction.itype.imm, 12));
+char *print_branch(char *out, const char *name, const Decoded *decoded) {
+    out = format_mnemonic(out, name);
+    *out++ = '\t';
+    out = format_reg(out, decoded->rs1);
+    out = format_str(out, ", ");
+    out = format_reg(out, decoded->rs2);
+    out = format_str(out, ", ");
+    out = format_int(out, decoded->imm);
+    *out++ = '\n';
+    return out;
 }
 
 
-void write_jal(Instruction instruction) {
-  /* YOUR CODE HERE */
-    printf(JAL_FORMAT, instruction.jtype.rd, bitExtender(get_jump_distance(instruction), 21));
+char *print_utype(char *out, const char *name, const Decoded *decoded) {
+    out = format_mnemonic(out, name);
+    *out++ = '\t';
+    out = format_reg(out, decoded->rd);
+    out = format_str(out, ", ");
+    out = format_int(out, (Word) decoded->imm >> 12);
+    *out++ = '\n';
+    return out;
 }
 
 
-void write_ecall(Instruction instruction) {
-  /* YOUR CODE HERE */
-   printf(ECALL_FORMAT);
+char *print_jal(char *out, const char *name, const Decoded *decoded) {
+    out = format_mnemonic(out, name);
+    *out++ = '\t';
+    out = format_reg(out, decoded->rd);
+    out = format_str(out, ", ");
+    out = format_int(out, decoded->imm);
+    *out++ = '\n';
+    return out;
 }
 
 
-void print_rtype(char *name, Instruction instruction) {
-  /* YOUR CODE HERE */
-    printf(RTYPE_FORMAT, name, instruction.rtype.rd, instruction.rtype.rs1, instruction.rtype.rs2);
+char *print_csr(char *out, const char *name, const Decoded *decoded) {
+    out = format_mnemonic(out, name);
+    *out++ = '\t';
+    out = format_reg(out, decoded->rd);
+    out = format_str(out, ", ");
+    out = format_csr(out, decoded->imm);
+    out = format_str(out, ", ");
+    if (instruction_specs[decoded->op].format == FORMAT_CSRI) out = format_int(out, decoded->rs1);
+    else out = format_reg(out, decoded->rs1);
+    *out++ = '\n';
+    return out;
 }
 
 
-void print_itype_except_load(char *name, Instruction instruction, int imm) { 
- /* YOUR CODE HERE */
-    printf(ITYPE_FORMAT, name, instruction.itype.rd, instruction.itype.rs1, bitExtender(imm, 12));
+char *print_lr(char *out, const char *name, const Decoded *decoded) {
+    out = format_mnemonic(out, name);
+    *out++ = '\t';
+    out = format_reg(out, decoded->rd);
+    out = format_str(out, ", (");
+    out = format_reg(out, decoded->rs1);
+    out = format_str(out, ")\n");
+    return out;
 }
 
-void print_load(char *name, Instruction instruction) {
- /* YOUR CODE HERE */
-    printf(MEM_FORMAT, name, instruction.itype.rd, bitExtender(instruction.itype.imm, 12), instruction.itype.rs1);
+
+char *print_amo(char *out, const char *name, const Decoded *decoded) {
+    out = format_mnemonic(out, name);
+    *out++ = '\t';
+    out = format_reg(out, decoded->rd);
+    out = format_str(out, ", ");
+    out = format_reg(out, decoded->rs2);
+    out = format_str(out, ", (");
+    out = format_reg(out, decoded->rs1);
+    out = format_str(out, ")\n");
+    return out;
 }
 
-void print_store(char *name, Instruction instruction) {
- /* YOUR CODE HERE */
-    printf(MEM_FORMAT, name, instruction.stype.rs2, get_memory_offset(instruction), instruction.stype.rs1);
+
+/* The short forms, named as written but with the operands of the
+   instruction they expand to, see COMPRESSED in isa.h */
+static char *print_compressed(char *out, const Decoded *decoded) {
+    const char *name = compressed_specs[decoded->compressed].name;
+
+    switch (compressed_specs[decoded->compressed].format) {
+        case FORMAT_I:
+            return print_itype(out, name, decoded);
+        case FORMAT_LOAD:
+            return print_load(out, name, decoded);
+        case FORMAT_S:
+            return print_store(out, name, decoded);
+        case FORMAT_CI:
+            out = format_mnemonic(out, name);
+            *out++ = '\t';
+            out = format_reg(out, decoded->rd);
+            out = format_str(out, ", ");
+            if (decoded->op == OP_lui) out = format_int(out, (Word) decoded->imm >> 12);
+            else out = format_int(out, decoded->imm);
+            break;
+        case FORMAT_CR:
+            out = format_mnemonic(out, name);
+            *out++ = '\t';
+            out = format_reg(out, decoded->rd);
+            out = format_str(out, ", ");
+            out = format_reg(out, decoded->rs2);
+            break;
+        case FORMAT_CJR:
+            out = format_mnemonic(out, name);
+            *out++ = '\t';
+            out = format_reg(out, decoded->rs1);
+            break;
+        case FORMAT_CB:
+            out = format_mnemonic(out, name);
+            *out++ = '\t';
+            out = format_reg(out, decoded->rs1);
+            out = format_str(out, ", ");
+            out = format_int(out, decoded->imm);
+            break;
+        case FORMAT_CJ:
+            out = format_mnemonic(out, name);
+            *out++ = '\t';
+            out = format_int(out, decoded->imm);
+            break;
+        default:
+            out = format_mnemonic(out, name);
+            break;
+    }
+    *out++ = '\n';
+    return out;
 }
 
-void print_branch(char *name, Instruction instruction) {
- /* YOUR CODE HERE */
-    printf(BRANCH_FORMAT, name, instruction.btype.rs1, instruction.btype.rs2, get_branch_distance(instruction));
+
+char *print_invalid(char *out, const Decoded *decoded) {
+    out = format_str(out, "Invalid Instruction: 0x");
+    out = format_hex(out, decoded->bits, 8);
+    *out++ = '\n';
+    return out;
 }
@@ -3,307 +3,400 @@
 #include "types.h"
 #include "utils.h"
 #include "riscv.h"
+#include "console.h"
+#include "replay.h"
+#include "debug.h"
+#include "csr.h"
+#include "fuzz.h"
+#include "predecode.h"
+#include "cosim.h"
+#include "aot.h"
+#include "bus.h"
+
+
+/* One handler per instruction in isa.h, named exec_<name>. Each one is
+   responsible for advancing the PC, by d->length past the instruction
+   since compressed ones run through the same handlers */
+#define EXEC(name) static inline void exec_##name(const Decoded *d, Processor *processor, Byte *memory)
 
-
-// forward declarations
-void execute_rtype(Instruction, Processor *);
-void execute_itype_except_load(Instruction, Processor *);
-void execute_branch(Instruction, Processor *);
-void execute_jalr(Instruction, Processor *);
-void execute_jal(Instruction, Processor *);
-void execute_load(Instruction, Processor *, Byte *);
-void execute_store(Instruction, Processor *, Byte *);
 void execute_ecall(Processor *, Byte *);
-void execute_auipc(Instruction, Processor *);
-void execute_lui(Instruction, Processor *);
+static void invalid(const Decoded *);
 
 
 void execute_instruction(Instruction instruction, Processor *processor, Byte *memory) {
-    switch (instruction.opcode) {
-        case 0b0110111:  // LUI
-            processor->PC += 4;
-            execute_lui(instruction, processor);
-            break;
-        case 0b0010111: // AUIPC
-            execute_auipc(instruction, processor);
-            processor->PC += 4;
-            break;
-        case 0b1101111: // JAL
-            execute_jal(instruction, processor);
-            break;
-        case 0b1100111: // JALR
-            execute_jalr(instruction, processor);
-            break;
-        case 0b1100011: // Branch
-            execute_branch(instruction, processor);
-            break;
-        case 0b0000011: // Load
-            execute_load(instruction, processor, memory);
-            break;
-        case 0b0100011: // Store
-            execute_store(instruction, processor, memory);
-            processor->PC += 4;
-            break;
-        case 0b0010011: // I-type except load
-            execute_itype_except_load(instruction, processor);
-            processor->PC += 4;
-            break;
-        case 0b1110011: // ECALL
-            execute_ecall(processor, memory);
-            break;
-        case 0b0110011: // R-type
-            processor->PC += 4;
-            execute_rtype(instruction, processor);
-            break;
-        default:
-            handle_invalid_instruction(instruction);
-            exit(-1);
-            break;
+    Decoded decoded;
+    decode(instruction, &decoded);
+    execute_decoded(&decoded, processor, memory);
+}
+
+
+EXEC(lui) {
+    processor->PC += d->length;
+    processor->R[d->rd] = d->imm;
+}
+
+EXEC(auipc) {
+    processor->R[d->rd] = processor->PC + d->imm;
+    processor->PC += d->length;
+}
+
+EXEC(jal) {
+    int jump_address = processor->PC + d->imm;
+    processor->R[d->rd] = processor->PC + d->length;
+    processor->PC = jump_address;
+}
+
+EXEC(jalr) {
+    // the target is taken before rd is written, which may be rs1
+    Word jump_address = (processor->R[d->rs1] + d->imm) & ~1;
+    processor->R[d->rd] = processor->PC + d->length;
+    processor->PC = jump_address;
+}
+
+EXEC(beq) {
+    if ((sWord)processor->R[d->rs1] == (sWord)processor->R[d->rs2]) {
+        processor->counters.events[EVENT_TAKEN_BRANCH]++;
+        processor->PC += d->imm;
+    } else {
+        processor->PC += d->length;
     }
 }
 
-void execute_rtype(Instruction instruction, Processor *processor) {
-    sDouble mul = 0;
-    sDouble mulh = 0;
-    switch (instruction.rtype.funct3) {
-        case 0x0: // R-type ADD, SUB
-            switch (instruction.rtype.funct7) {
-                case 0x0:
-                    processor->R[instruction.rtype.rd] = ((sWord)processor->R[instruction.rtype.rs1]) + ((sWord)processor->R[instruction.rtype.rs2]);
-                    break;
-                case 0x20:
-                    processor->R[instruction.rtype.rd] = ((sWord)processor->R[instruction.rtype.rs1]) - ((sWord)processor->R[instruction.rtype.rs2]);
-                    break;
-                case 0x01:
-	                mul = ((sDouble)processor->R[instruction.rtype.rs1] * (sDouble)processor->R[instruction.rtype.rs2]);
-                    processor->R[instruction.rtype.rd] = (int)((mul << 31)>>31); 
-	                break;
-                default:
-                    handle_invalid_instruction(instruction);
-                    break;
-            }
-            break;
+EXEC(bne) {
+    if ((sWord)processor->R[d->rs1] != (sWord)processor->R[d->rs2]) {
+        processor->counters.events[EVENT_TAKEN_BRANCH]++;
+        processor->PC += d->imm;
+    } else {
+        processor->PC += d->length;
+    }
+}
 
-        case 0x1:
-	       switch(instruction.rtype.funct7) {
-	            case 0x0: //sll
-	                processor->R[instruction.rtype.rd] = ((sWord)processor->R[instruction.rtype.rs1]) << ((sWord)processor->R[instruction.rtype.rs2]);
-	                break;
-	            case 0x1: //mulh
-	                mulh = ((sDouble)processor->R[instruction.rtype.rs1] * (sDouble)processor->R[instruction.rtype.rs2])>>32;
-                    processor->R[instruction.rtype.rd] = mulh; 
-	                break;
-	        }
-            break;
+EXEC(lb) {
+    processor->counters.events[EVENT_LOAD]++;
+    processor->R[d->rd] = sign_extend(load(memory, processor->R[d->rs1] + d->imm, LENGTH_BYTE, 0), 8);
+    processor->PC += d->length;
+}
 
-	    case 0x2:
-	       switch(instruction.rtype.funct7) {
-	            case 0x0: //slt
-	            processor->R[instruction.rtype.rd] = (sWord)processor->R[instruction.rtype.rs1] < (sWord)processor->R[instruction.rtype.rs2] ? 1 : 0;
-	            break;
-	        }
-            break;
+EXEC(lh) {
+    processor->counters.events[EVENT_LOAD]++;
+    processor->R[d->rd] = sign_extend(load(memory, processor->R[d->rs1] + d->imm, LENGTH_HALF_WORD, 0), 16);
+    processor->PC += d->length;
+}
 
-	 case 0x4:
-	       switch(instruction.rtype.funct7) {
-	            case 0x0: //xor
-	                processor->R[instruction.rtype.rd] = (sWord)processor->R[instruction.rtype.rs1] ^ (sWord)processor->R[instruction.rtype.rs2];
-	                break;
-	            case 0x1: //div
-                    if((sWord)(processor->R[instruction.rtype.rs2] == 0)){
-                        processor->R[instruction.rtype.rd] = -1;
-                    }
-                    else if ((sWord)processor->R[instruction.rtype.rs1] == 0x80000000 && (sWord)processor->R[instruction.rtype.rs2] == 0xffffffff){
-                        processor->R[instruction.rtype.rd] = (sWord)processor->R[instruction.rtype.rs1];
-                    }
-                    else{
-                        processor->R[instruction.rtype.rd] = ((sWord)processor->R[instruction.rtype.rs1]) / ((sWord)processor->R[instruction.rtype.rs2]);
-                    } 
-                break;
-	        }
-            break;
+EXEC(lw) {
+    processor->counters.events[EVENT_LOAD]++;
+    processor->R[d->rd] = load(memory, processor->R[d->rs1] + d->imm, LENGTH_WORD, 0);
+    processor->PC += d->length;
+}
 
-	case 0x5:
-	       switch(instruction.rtype.funct7) {
-	            case 0x0: //srl
-	                processor->R[instruction.rtype.rd] = processor->R[instruction.rtype.rs1] >> processor->R[instruction.rtype.rs2];
-	                break;
-	            case 0x20: //sra
-	                processor->R[instruction.rtype.rd] = (sWord)processor->R[instruction.rtype.rs1] >> (sWord)processor->R[instruction.rtype.rs2];
-	                break;
-	        }
-            break;
+EXEC(sb) {
+    processor->counters.events[EVENT_STORE]++;
+    store(memory, processor->R[d->rs1] + d->imm, LENGTH_BYTE, processor->R[d->rs2], 0);
+    processor->PC += d->length;
+}
 
-	case 0x6:
-	       switch(instruction.rtype.funct7) {      
-	            case 0x0: //or
-	                processor->R[instruction.rtype.rd] = (sWord)processor->R[instruction.rtype.rs1] | (sWord)processor->R[instruction.rtype.rs2];
-	                break;
-	            case 0x1: //rem
-                    if((sWord)(processor->R[instruction.rtype.rs2] == 0)){
-                        processor->R[instruction.rtype.rd] = (sWord)processor->R[instruction.rtype.rs1];
-                    }
-                    else if ((sWord)processor->R[instruction.rtype.rs1] == 0x80000000 && (sWord)processor->R[instruction.rtype.rs2] == 0xffffffff){
-                        processor->R[instruction.rtype.rd] = 0;
-                    }
-                    else{
-                        processor->R[instruction.rtype.rd] = (sWord)processor->R[instruction.rtype.rs1] % (sWord)processor->R[instruction.rtype.rs2];
-                    } 
-                    break;
-	        }     
-            break;
+EXEC(sh) {
+    processor->counters.events[EVENT_STORE]++;
+    store(memory, processor->R[d->rs1] + d->imm, LENGTH_HALF_WORD, processor->R[d->rs2], 0);
+    processor->PC += d->length;
+}
 
-	case 0x7:
-	       switch(instruction.rtype.funct7) {       
-	            case 0x0: //and
-	            processor->R[instruction.rtype.rd] = (sWord)processor->R[instruction.rtype.rs1] & (sWord)processor->R[instruction.rtype.rs2];
-	            break;
-	        }
-            break;
+EXEC(sw) {
+    processor->counters.events[EVENT_STORE]++;
+    store(memory, processor->R[d->rs1] + d->imm, LENGTH_WORD, processor->R[d->rs2], 0);
+    processor->PC += d->length;
+}
 
-        default:
-            handle_invalid_instruction(instruction);
-            exit(-1);
-            break;
-    }
+EXEC(addi) {
+    processor->R[d->rd] = processor->R[d->rs1] + d->imm;
+    processor->PC += d->length;
+}
 
+EXEC(slti) {
+    processor->R[d->rd] = (sWord)processor->R[d->rs1] < d->imm ? 1 : 0;
+    processor->PC += d->length;
 }
 
+EXEC(xori) {
+    processor->R[d->rd] = processor->R[d->rs1] ^ d->imm;
+    processor->PC += d->length;
+}
 
-void execute_itype_except_load(Instruction instruction, Processor *processor) {
-    switch(instruction.itype.funct3) {
-        case 0x0: //addi
-            processor->R[instruction.itype.rd] = (sWord)processor->R[instruction.itype.rs1] + bitExtender(instruction.itype.imm, 12);
-            break;
-        case 0x1: //slli
-            processor->R[instruction.itype.rd] = (sWord)processor->R[instruction.itype.rs1] << bitExtender(instruction.itype.imm, 12);
-            break;
-        case 0x2: //slti
-            processor->R[instruction.itype.rd] = (((sWord)processor->R[instruction.itype.rs1] < bitExtender(instruction.itype.imm, 12)) ? 1 : 0);
-            break;
-        case 0x4: //xori
-            processor->R[instruction.itype.rd] = (sWord)processor->R[instruction.itype.rs1] ^ bitExtender(instruction.itype.imm, 12);
-            break;          
-        case 0x6: //ori
-            processor->R[instruction.itype.rd] = (sWord)processor->R[instruction.itype.rs1] | bitExtender(instruction.itype.imm, 12);
-            break;  
-        case 0x7: //andi
-            processor->R[instruction.itype.rd] = (sWord)processor->R[instruction.itype.rs1] & bitExtender(instruction.itype.imm, 12);
-            break;  
-        case 0x5: //srai - srli
-            if (instruction.itype.imm >> 5 == 0b0100000){ 
-                processor->R[instruction.itype.rd] = (sWord)processor->R[instruction.itype.rs1] >> bitExtender(instruction.itype.imm, 12); 
-                break;      
-            }
-            processor->R[instruction.itype.rd] = processor->R[instruction.itype.rs1] >> bitExtender(instruction.itype.imm, 12);
-            break;
-        default:
-            handle_invalid_instruction(instruction);
-            exit(-1);
-            break;
-    }
+EXEC(ori) {
+    processor->R[d->rd] = processor->R[d->rs1] | d->imm;
+    processor->PC += d->length;
+}
 
+EXEC(andi) {
+    processor->R[d->rd] = processor->R[d->rs1] & d->imm;
+    processor->PC += d->length;
 }
 
-void execute_ecall(Processor *processor, Byte *memory) {
-    switch (processor->R[10]) { 
-        case 1: 
-            printf("%d", (int)processor->R[11]);
-            processor->PC += 4;
-            break;
-        case 10: 
-            printf("exiting the simulator\n");
-            exit(0);
-            break;
-        default:
-            printf("Illegal ecall number %d\n", processor->R[10]);
-            exit(-1);
-            break;
-    }
+EXEC(slli) {
+    processor->R[d->rd] = processor->R[d->rs1] << d->imm;
+    processor->PC += d->length;
 }
 
+EXEC(srli) {
+    processor->R[d->rd] = processor->R[d->rs1] >> d->imm;
+    processor->PC += d->length;
+}
 
-void execute_branch(Instruction instruction, Processor *processor) {
-    switch(instruction.btype.funct3) {
-        case 0x0: //beq
-            if((sWord)processor->R[instruction.rtype.rs1] == (sWord)processor->R[instruction.rtype.rs2]) {
-                processor->PC += get_branch_distance(instruction);
-            } else {
-                processor->PC += 4;
-            }
-            break;
-        case 0x1: //bne
-            if((sWord)processor->R[instruction.rtype.rs1] != (sWord)processor->R[instruction.rtype.rs2]) {
-                processor->PC += get_branch_distance(instruction);
-            } else {
-                processor->PC += 4;
-            }
-            break;
-        default:
-            handle_invalid_instruction(instruction);
-            exit(-1);
-            break;
+EXEC(srai) {
+    processor->R[d->rd] = (sWord)processor->R[d->rs1] >> d->imm;
+    processor->PC += d->length;
+}
+
+EXEC(add) {
+    processor->PC += d->length;
+    processor->R[d->rd] = processor->R[d->rs1] + processor->R[d->rs2];
+}
+
+EXEC(sub) {
+    processor->PC += d->length;
+    processor->R[d->rd] = processor->R[d->rs1] - processor->R[d->rs2];
+}
+
+EXEC(sll) {
+    processor->PC += d->length;
+    processor->R[d->rd] = processor->R[d->rs1] << (processor->R[d->rs2] & 31);
+}
+
+EXEC(slt) {
+    processor->PC += d->length;
+    processor->R[d->rd] = (sWord)processor->R[d->rs1] < (sWord)processor->R[d->rs2] ? 1 : 0;
+}
+
+EXEC(xor) {
+    processor->PC += d->length;
+    processor->R[d->rd] = processor->R[d->rs1] ^ processor->R[d->rs2];
+}
+
+EXEC(srl) {
+    processor->PC += d->length;
+    processor->R[d->rd] = processor->R[d->rs1] >> (processor->R[d->rs2] & 31);
+}
+
+EXEC(sra) {
+    processor->PC += d->length;
+    processor->R[d->rd] = (sWord)processor->R[d->rs1] >> (processor->R[d->rs2] & 31);
+}
+
+EXEC(or) {
+    processor->PC += d->length;
+    processor->R[d->rd] = processor->R[d->rs1] | processor->R[d->rs2];
+}
+
+EXEC(and) {
+    processor->PC += d->length;
+    processor->R[d->rd] = processor->R[d->rs1] & processor->R[d->rs2];
+}
+
+EXEC(mul) {
+    processor->counters.events[EVENT_MULDIV]++;
+    processor->PC += d->length;
+    processor->R[d->rd] = processor->R[d->rs1] * processor->R[d->rs2];
+}
+
+/* NOTE: the operands are zero-extended, so this yields the high word of the
+   unsigned product. The reference traces in riscvcode/ref depend on it */
+EXEC(mulh) {
+    processor->counters.events[EVENT_MULDIV]++;
+    processor->PC += d->length;
+    processor->R[d->rd] = ((Double)processor->R[d->rs1] * (Double)processor->R[d->rs2]) >> 32;
+}
+
+EXEC(div) {
+    processor->counters.events[EVENT_MULDIV]++;
+    processor->PC += d->length;
+    if (processor->R[d->rs2] == 0) {
+        processor->R[d->rd] = -1;
+    } else if (processor->R[d->rs1] == 0x80000000 && processor->R[d->rs2] == 0xffffffff) {
+        processor->R[d->rd] = processor->R[d->rs1];
+    } else {
+        processor->R[d->rd] = (sWord)processor->R[d->rs1] / (sWord)processor->R[d->rs2];
     }
 }
 
+EXEC(rem) {
+    processor->counters.events[EVENT_MULDIV]++;
+    processor->PC += d->length;
+    if (processor->R[d->rs2] == 0) {
+        processor->R[d->rd] = processor->R[d->rs1];
+    } else if (processor->R[d->rs1] == 0x80000000 && processor->R[d->rs2] == 0xffffffff) {
+        processor->R[d->rd] = 0;
+    } else {
+        processor->R[d->rd] = (sWord)processor->R[d->rs1] % (sWord)processor->R[d->rs2];
+    }
+}
 
-void execute_load(Instruction instruction, Processor *processor, Byte *memory) {
-    switch(instruction.itype.funct3) {
-        case 0x0: //lb
-            processor->R[instruction.itype.rd] = bitExtender(load(memory, (sWord)processor->R[instruction.itype.rs1] + ((sWord)bitExtender(instruction.itype.imm , 12)) , LENGTH_BYTE, 0), 8 );
-            processor->PC += 4;
-            break;
-        case 0x1: //lh
-            processor->R[instruction.itype.rd] = bitExtender(load(memory, (sWord)processor->R[instruction.itype.rs1] + ((sWord)bitExtender(instruction.itype.imm , 12)) , LENGTH_HALF_WORD, 0), 16 );
-            processor->PC += 4;
-            break;
-        case 0x2: //lw
-            processor->R[instruction.itype.rd] = load(memory, (sWord)processor->R[instruction.itype.rs1] + ((sWord)bitExtender(instruction.itype.imm , 12)) , LENGTH_WORD, 0);
-            processor->PC += 4;
+EXEC(ecall) {
+    execute_ecall(processor, memory);
+}
+
+
+/* Zicsr, kind being funct3 without the immediate bit: 1 write, 2 set
+   bits, 3 clear bits. An access the CSR does not allow is an invalid instruction.
+   rd = x0 skips the read of csrrw(i), and rs1 = x0 or a zero immediate
+   skips the write of the set and clear forms */
+static inline void csr_access(const Decoded *d, Processor *processor, Word operand, int kind) {
+    Word value = 0;
+    int read = d->rd != 0 || kind != 1;
+    int write = kind == 1 || d->rs1 != 0;
+
+    if (read && !csr_read(processor, d->imm, &value)) invalid(d);
+    switch (kind) {
+        case 2:
+            operand = value | operand;
             break;
-        default:
-            handle_invalid_instruction(instruction);
+        case 3:
+            operand = value & ~operand;
             break;
     }
+    if (write && !csr_write(processor, d->imm, operand)) invalid(d);
+    processor->R[d->rd] = value;
+    processor->PC += d->length;
 }
 
+EXEC(csrrw) {
+    csr_access(d, processor, processor->R[d->rs1], 1);
+}
 
-void execute_store(Instruction instruction, Processor *processor, Byte *memory) {
-    switch(instruction.itype.funct3) {
-        case 0x0: //sb
-            store(memory, ((sWord)processor->R[instruction.stype.rs1]) + ((sWord)get_memory_offset(instruction)), LENGTH_BYTE , processor->R[instruction.stype.rs2], 0);
-            break;
-        case 0x1: //sh
-            store(memory, ((sWord)processor->R[instruction.stype.rs1]) + ((sWord)get_memory_offset(instruction)), LENGTH_HALF_WORD , processor->R[instruction.stype.rs2], 0);
-            break;
-        case 0x2: //sw
-            store(memory, ((sWord)processor->R[instruction.stype.rs1]) + ((sWord)get_memory_offset(instruction)), LENGTH_WORD , processor->R[instruction.stype.rs2], 0);
-            break;
-        default:
-            handle_invalid_instruction(instruction);
-            exit(-1);
-            break;
+EXEC(csrrs) {
+    csr_access(d, processor, processor->R[d->rs1], 2);
+}
+
+EXEC(csrrc) {
+    csr_access(d, processor, processor->R[d->rs1], 3);
+}
+
+EXEC(csrrwi) {
+    csr_access(d, processor, d->rs1, 1);
+}
+
+EXEC(csrrsi) {
+    csr_access(d, processor, d->rs1, 2);
+}
+
+EXEC(csrrci) {
+    csr_access(d, processor, d->rs1, 3);
+}
+
+
+/* RV32A. Other harts run on other host threads, so these go straight to
+   host atomics on guest memory, whose words are little-endian like the
+   host's. Every one is sequentially consistent whatever aq/rl say */
+static Word *atomic_word(Byte *memory, Address address, int write) {
+    if (!check(address, LENGTH_WORD)) {
+        if (write) handle_invalid_write(address);
+        else handle_invalid_read(address);
     }
+    if (write && page_hooks[address >> PAGE_SHIFT]) store_hook(address, LENGTH_WORD);
+    return (Word *) (memory + address);
 }
 
+/* SC succeeds while the word still holds what LR read. Unlike a real
+   reservation, a store of that same value in between goes unnoticed */
+EXEC(lr_w) {
+    Word *word = atomic_word(memory, processor->R[d->rs1], 0);
+    processor->reservation = processor->R[d->rs1];
+    processor->reserved_value = __atomic_load_n(word, __ATOMIC_SEQ_CST);
+    processor->R[d->rd] = processor->reserved_value;
+    processor->PC += d->length;
+}
 
-void execute_jalr(Instruction instruction, Processor *processor) {
-	processor->R[instruction.itype.rd] = processor->PC + 4;  
-	processor->PC = (processor->R[instruction.stype.rs1] + bitExtender(instruction.itype.imm, 12));
+EXEC(sc_w) {
+    Word *word = atomic_word(memory, processor->R[d->rs1], 1);
+    int stored = processor->reservation == processor->R[d->rs1]
+        && __atomic_compare_exchange_n(word, &processor->reserved_value, processor->R[d->rs2],
+                                       0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    processor->reservation = NO_RESERVATION;
+    processor->R[d->rd] = !stored;
+    processor->PC += d->length;
 }
 
-void execute_jal(Instruction instruction, Processor *processor) {
-	int jump_address = processor->PC + (sWord)get_jump_distance(instruction);
-	processor->R[instruction.jtype.rd] = processor->PC + 4;
-	processor->PC = jump_address;
+#define AMO(name, update) \
+    EXEC(name) { \
+        Word *word = atomic_word(memory, processor->R[d->rs1], 1); \
+        Word value = processor->R[d->rs2]; \
+        processor->R[d->rd] = update; \
+        processor->PC += d->length; \
+    }
+
+/* min and max: value replaces the word when value keep_value old */
+#define AMO_COMPARE(name, type, keep_value) \
+    static inline Word name(Word *word, Word value) { \
+        Word old = __atomic_load_n(word, __ATOMIC_SEQ_CST); \
+        while ((type) value keep_value (type) old \
+               && !__atomic_compare_exchange_n(word, &old, value, 1, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)); \
+        return old; \
+    }
+
+AMO_COMPARE(atomic_min, sWord, <)
+AMO_COMPARE(atomic_max, sWord, >)
+AMO_COMPARE(atomic_minu, Word, <)
+AMO_COMPARE(atomic_maxu, Word, >)
+
+AMO(amoswap_w, __atomic_exchange_n(word, value, __ATOMIC_SEQ_CST))
+AMO(amoadd_w, __atomic_fetch_add(word, value, __ATOMIC_SEQ_CST))
+AMO(amoxor_w, __atomic_fetch_xor(word, value, __ATOMIC_SEQ_CST))
+AMO(amoand_w, __atomic_fetch_and(word, value, __ATOMIC_SEQ_CST))
+AMO(amoor_w, __atomic_fetch_or(word, value, __ATOMIC_SEQ_CST))
+AMO(amomin_w, atomic_min(word, value))
+AMO(amomax_w, atomic_max(word, value))
+AMO(amominu_w, atomic_minu(word, value))
+AMO(amomaxu_w, atomic_maxu(word, value))
+
+#undef AMO
+#undef AMO_COMPARE
+
+
+void execute_decoded(const Decoded *decoded, Processor *processor, Byte *memory) {
+#define DISPATCH(name, format, match, mask) \
+    case OP_##name: \
+        exec_##name(decoded, processor, memory); \
+        break;
+
+    switch (decoded->op) {
+        INSTRUCTIONS(DISPATCH)
+        default:
+            invalid(decoded);
+            break;
+    }
+#undef DISPATCH
+    processor->counters.instret++;
 }
 
-void execute_auipc(Instruction instruction, Processor *processor) {
-	processor->R[instruction.utype.rd] = (processor->PC + (instruction.utype.imm << 12));
+
+static void invalid(const Decoded *decoded) {
+    Instruction instruction = { .bits = decoded->bits };
+    handle_invalid_instruction(instruction);
+    halt_simulation(-1);
 }
 
-void execute_lui(Instruction instruction, Processor *processor) {
-	processor->R[instruction.utype.rd] = (instruction.utype.imm << 12);
+
+void execute_ecall(Processor *processor, Byte *memory) {
+    switch (processor->R[10]) { 
+        case 1: 
+            console_print_int(processor->R[11]);
+            processor->PC += 4;
+            break;
+        case 10: 
+            console_report("exiting the simulator\n");
+            halt_simulation(0);
+            break;
+        case 15: // write(fd = a1, buf = a2, len = a3), returns bytes written in a0
+            if (processor->R[12] >= MEMORY_SPACE || processor->R[13] > MEMORY_SPACE - processor->R[12]) {
+                handle_invalid_read(processor->R[12]);
+            }
+            processor->R[10] = console_write(processor->R[11], memory + processor->R[12], processor->R[13]);
+            processor->PC += 4;
+            break;
+        default:
+            console_report("Illegal ecall number %d\n", processor->R[10]);
+            halt_simulation(-1);
+            break;
+    }
 }
 
 
@@ -321,11 +414,42 @@ int check(Address address, Alignment alignment) {
 }
 
 
+/* Per-page flags that send stores through store_hook() before they land.
+   Keeps store() to a single byte test when no one is watching memory */
+Byte page_hooks[PAGE_COUNT];
+
+
+void store_hook(Address address, Alignment alignment) {
+    Address page = address >> PAGE_SHIFT;
+    Address last = (address + alignment - 1) >> PAGE_SHIFT;
+    Byte hooks = 0;
+
+    // unaligned data stores can straddle two pages
+    if (last >= PAGE_COUNT) last = PAGE_COUNT - 1;
+    for (; page <= last; page++) {
+        hooks |= page_hooks[page];
+        if (page_hooks[page] & PAGE_HOOK_UNDO) replay_save_page(page);
+        if (page_hooks[page] & PAGE_HOOK_DIRTY) fuzz_mark_dirty(page);
+    }
+    if (hooks & PAGE_HOOK_WATCH) debug_watch_store(address, alignment);
+    if (hooks & PAGE_HOOK_CODE) predecode_invalidate(address, alignment);
+    if (hooks & PAGE_HOOK_COSIM) cosim_store(address, alignment);
+    if (hooks & PAGE_HOOK_AOT) aot_store(address, alignment);
+}
+
+
 void store(Byte *memory, Address address, Alignment alignment, Word value, int check_align) {
-    if ((check_align && !check(address, alignment)) || (address >= MEMORY_SPACE)) {
+    // past RAM is the device bus, see bus.c
+    if (address >= MEMORY_SPACE) {
+        bus_store(memory, address, alignment, value);
+        return;
+    }
+    if (check_align && !check(address, alignment)) {
         handle_invalid_write(address);
     }
 
+    if (page_hooks[address >> PAGE_SHIFT] | page_hooks[(address + alignment - 1) >> PAGE_SHIFT & (PAGE_COUNT - 1)]) store_hook(address, alignment);
+
     switch (alignment) {
         case LENGTH_BYTE:
             memory[address] = value & 0xFF;
@@ -348,7 +472,12 @@ void store(Byte *memory, Address address, Alignment alignment, Word value, int c
 
 
 Word load(Byte *memory, Address address, Alignment alignment, int check_align) {
-    if ((check_align && !check(address, alignment)) || (address >= MEMORY_SPACE)) {
+    // past RAM is the device bus, see bus.c, but no code runs from there
+    if (address >= MEMORY_SPACE) {
+        if (check_align) handle_invalid_read(address);
+        return bus_load(memory, address, alignment);
+    }
+    if (check_align && !check(address, alignment)) {
         handle_invalid_read(address);
     }
 
@@ -373,3 +502,18 @@ Word load(Byte *memory, Address address, Alignment alignment, int check_align) {
     }
     return value;
 }
+
+
+/* Fetches the instruction at pc, which with the C extension need only be
+   halfword aligned: a compressed one is its first halfword alone */
+Word fetch(Byte *memory, Address pc) {
+    Word bits;
+    // most code is word aligned, and then a single load will do
+    if (check(pc, LENGTH_WORD)) {
+        bits = load(memory, pc, LENGTH_WORD, 0);
+        return is_compressed(bits) ? bits & 0xFFFF : bits;
+    }
+    bits = load(memory, pc, LENGTH_HALF_WORD, 1);
+    if (is_compressed(bits)) return bits;
+    return bits | load(memory, pc + 2, LENGTH_HALF_WORD, 1) << 16;
+}
@@ -0,0 +1,300 @@
+#include <stdlib.h>
+#include <string.h>
+#include "predecode.h"
+#include "riscv.h"
+#include "stats.h"
+
+
+/* A faster engine than execute(): the instruction at each halfword of
+   guest memory is decoded the first time it runs and the Decoded record
+   kept. Stores to a page holding any such record go through
+   PAGE_HOOK_CODE, which drops the records they overwrite, so code that
+   writes code still runs whatever memory holds. -C checks it against
+   the interpreter, see cosim.c.
+
+   Common pairs of instructions are also fused into one dispatch, see
+   fuse(). A fused pair retires both instructions at once, so the PC and
+   registers are never seen between them */
+
+/* Decoded.op of a halfword not decoded yet */
+#define EMPTY 0xff
+
+/* What starts at a halfword: a single instruction or one of these pairs
+   of 4-byte instructions */
+typedef enum {
+  FUSED_UNKNOWN,    // not looked at since the memory was last written
+  FUSED_NONE,
+  FUSED_LUI_ADDI,   // lui rd, hi; addi rd2, rd, lo: li and la
+  FUSED_AUIPC_JALR, // auipc rd, hi; jalr rd2, lo(rd): call and tail
+  FUSED_ADDI_BEQ,   // addi rd, rs1, imm; beq ...: loop counters
+  FUSED_ADDI_BNE,
+  FUSED_LW_ADDI,    // lw rd, off(rs1); addi ...: walking an array
+  FUSED_SW_ADDI,
+} Fused;
+
+/* Set in fused[] on the first halfword of each basic block of a prepared
+   image, where the engine counts blocks run for the image's profile */
+#define FUSED_LEADER 0x80
+
+static Decoded *cache;
+static Byte *fused;
+static int fusing;
+
+/* Blocks run, added to the image's profile at exit */
+static Word *entries;
+static Double *profile;
+
+Double predecode_misses, predecode_invalidations;
+
+static Fused fuse(Address pc, const Decoded *first, Byte *memory);
+
+
+/* Where basic blocks start: the entry point, the targets of branches
+   and jal, and whatever follows a change of control flow. Instructions
+   are found the way -d lists them, each right after the one before */
+static void mark_leaders(Byte *leaders, const Decoded *records, Address base, size_t size) {
+  Address pc, target;
+  const Decoded *d;
+
+  leaders[base >> 1] |= FUSED_LEADER;
+  for (pc = base; pc < base + size; pc += d->length) {
+    d = &records[pc >> 1];
+    switch (d->op) {
+      case OP_beq:
+      case OP_bne:
+      case OP_jal:
+        target = pc + d->imm;
+        if (target - base < size) leaders[target >> 1] |= FUSED_LEADER;
+        // fall through
+      case OP_jalr:
+      case OP_ecall:
+        if (pc + d->length - base < size) leaders[(pc + d->length) >> 1] |= FUSED_LEADER;
+        break;
+    }
+  }
+}
+
+
+void predecode_prepare(Decoded *records, Byte *leaders, Byte *memory, Address base, size_t size) {
+  Address pc;
+  Instruction instruction;
+
+  if (size > MEMORY_SPACE - base) size = MEMORY_SPACE - base;
+  size &= ~3;
+  memset(records, EMPTY, CODE_SLOTS * sizeof(Decoded));
+  // every halfword, whatever a jump might find there
+  for (pc = base; pc < base + size; pc += 2) {
+    instruction.bits = 0;
+    memcpy(&instruction.bits, memory + pc, pc + 4 <= base + size ? 4 : 2);
+    decode(instruction, &records[pc >> 1]);
+  }
+
+  memset(leaders, FUSED_UNKNOWN, CODE_SLOTS);
+  mark_leaders(leaders, records, base, size);
+
+  // pairs within the image, so that runs need not look for them
+  cache = records;
+  fused = leaders;
+  for (pc = base; pc + 4 < base + size; pc += records[pc >> 1].length) {
+    leaders[pc >> 1] |= fuse(pc, &records[pc >> 1], memory);
+  }
+  cache = NULL;
+  fused = NULL;
+}
+
+
+static void save_profile(void) {
+  Word slot;
+  for (slot = 0; slot < CODE_SLOTS; slot++) {
+    if (entries[slot]) __atomic_fetch_add(&profile[slot], entries[slot], __ATOMIC_RELAXED);
+  }
+}
+
+
+void predecode_init(int fuse, const Image *image) {
+  Address page;
+
+  if (image) {
+    cache = image->records;
+    // stores must still find what was decoded ahead of time
+    for (page = image->base >> PAGE_SHIFT; page < (image->base + image->size + PAGE_SIZE - 1) >> PAGE_SHIFT && page < PAGE_COUNT; page++) {
+      page_hooks[page] |= PAGE_HOOK_CODE;
+    }
+  } else {
+    cache = malloc(CODE_SLOTS * sizeof(Decoded));
+    memset(cache, EMPTY, CODE_SLOTS * sizeof(Decoded));
+  }
+
+  // the image's pairs and block leaders are only any use when fusing
+  if (image && fuse) {
+    fused = image->fused;
+    entries = calloc(CODE_SLOTS, sizeof(Word));
+    profile = image->profile;
+    atexit(save_profile);
+  } else {
+    fused = calloc(CODE_SLOTS, 1);
+  }
+  fusing = fuse;
+}
+
+
+/* A record covers the halfword it starts at and, for a 4-byte
+   instruction, the next one, and a fused pair four halfwords */
+void predecode_invalidate(Address address, Alignment alignment) {
+  Address first = address >> 1, last = (address + alignment - 1) >> 1, slot;
+  if (last >= CODE_SLOTS) last = CODE_SLOTS - 1;
+  for (slot = first >= 3 ? first - 3 : 0; slot <= last; slot++) {
+    fused[slot] &= FUSED_LEADER;
+    if (slot + 1 < first) continue;
+    if (cache[slot].op != EMPTY) predecode_invalidations++;
+    cache[slot].op = EMPTY;
+  }
+}
+
+
+static Decoded *predecode(Address pc, Byte *memory) {
+  Decoded *decoded = &cache[pc >> 1];
+  Instruction instruction;
+  if (decoded->op == EMPTY) {
+    stats_phase = STATS_DECODE;
+    predecode_misses++;
+    instruction.bits = fetch(memory, pc);
+    decode(instruction, decoded);
+    page_hooks[pc >> PAGE_SHIFT] |= PAGE_HOOK_CODE;
+    stats_phase = STATS_EXECUTE;
+  }
+  return decoded;
+}
+
+
+/* Picks the pair starting with first at pc, if the next instruction makes
+   one and does not start a basic block. Both must be 4 bytes long. A
+   first instruction that writes must not write x0, since the second
+   would read it before x0 is cleared again */
+static Fused fuse(Address pc, const Decoded *first, Byte *memory) {
+  const Decoded *second;
+
+  if (first->length != 4) return FUSED_NONE;
+  switch (first->op) {
+    case OP_lui:
+    case OP_auipc:
+    case OP_addi:
+    case OP_lw:
+      if (first->rd == 0) return FUSED_NONE;
+      break;
+    case OP_sw:
+      break;
+    default:
+      return FUSED_NONE;
+  }
+  if (pc + 8 > MEMORY_SPACE || (fused[(pc + 4) >> 1] & FUSED_LEADER)) return FUSED_NONE;
+
+  second = predecode(pc + 4, memory);
+  if (second->length != 4) return FUSED_NONE;
+  switch (first->op) {
+    case OP_lui:
+      if (second->op == OP_addi && second->rs1 == first->rd) return FUSED_LUI_ADDI;
+      break;
+    case OP_auipc:
+      if (second->op == OP_jalr && second->rs1 == first->rd) return FUSED_AUIPC_JALR;
+      break;
+    case OP_addi:
+      if (second->op == OP_beq) return FUSED_ADDI_BEQ;
+      if (second->op == OP_bne) return FUSED_ADDI_BNE;
+      break;
+    case OP_lw:
+      if (second->op == OP_addi) return FUSED_LW_ADDI;
+      break;
+    case OP_sw:
+      if (second->op == OP_addi) return FUSED_SW_ADDI;
+      break;
+  }
+  return FUSED_NONE;
+}
+
+
+/* The second instruction of a compare-and-branch pair, at pc + 4 */
+static void branch(Processor *processor, Address pc, const Decoded *d, int taken) {
+  if (taken) {
+    processor->counters.events[EVENT_TAKEN_BRANCH]++;
+    processor->PC = pc + 4 + d->imm;
+  } else {
+    processor->PC = pc + 8;
+  }
+}
+
+
+void predecode_execute(Processor *processor, Byte *memory) {
+  Address pc = processor->PC, slot = pc >> 1;
+  Register *R = processor->R;
+  const Decoded *d, *e;
+  Byte pair;
+
+  // the same bad fetches as execute(), reported the same way
+  if (!check(pc, LENGTH_HALF_WORD)) fetch(memory, pc);
+
+  d = predecode(pc, memory);
+  pair = fused[slot];
+  if (pair & FUSED_LEADER) {
+    entries[slot]++;
+    pair &= ~FUSED_LEADER;
+  }
+  if (pair == FUSED_UNKNOWN) {
+    pair = fusing ? fuse(pc, d, memory) : FUSED_NONE;
+    fused[slot] |= pair;
+  }
+  e = &cache[slot + 2];
+
+  // each pair does what its two instructions would, in the same order
+  switch (pair) {
+    default:
+      execute_decoded(d, processor, memory);
+      break;
+    case FUSED_LUI_ADDI:
+      R[d->rd] = d->imm;
+      R[e->rd] = R[e->rs1] + e->imm;
+      processor->PC = pc + 8;
+      processor->counters.instret += 2;
+      break;
+    case FUSED_AUIPC_JALR:
+      // jalr's rs1 is auipc's rd, but its own rd may be the same register
+      processor->PC = (pc + d->imm + e->imm) & ~1;
+      R[d->rd] = pc + d->imm;
+      R[e->rd] = pc + 8;
+      processor->counters.instret += 2;
+      break;
+    case FUSED_ADDI_BEQ:
+      R[d->rd] = R[d->rs1] + d->imm;
+      branch(processor, pc, e, (sWord) R[e->rs1] == (sWord) R[e->rs2]);
+      processor->counters.instret += 2;
+      break;
+    case FUSED_ADDI_BNE:
+      R[d->rd] = R[d->rs1] + d->imm;
+      branch(processor, pc, e, (sWord) R[e->rs1] != (sWord) R[e->rs2]);
+      processor->counters.instret += 2;
+      break;
+    case FUSED_LW_ADDI:
+      processor->counters.events[EVENT_LOAD]++;
+      R[d->rd] = load(memory, R[d->rs1] + d->imm, LENGTH_WORD, 0);
+      R[e->rd] = R[e->rs1] + e->imm;
+      processor->PC = pc + 8;
+      processor->counters.instret += 2;
+      break;
+    case FUSED_SW_ADDI:
+      processor->counters.events[EVENT_STORE]++;
+      store(memory, R[d->rs1] + d->imm, LENGTH_WORD, R[d->rs2], 0);
+      processor->counters.instret++;
+      // the store may have replaced the addi, which then runs on its own
+      if ((fused[slot] & ~FUSED_LEADER) != FUSED_SW_ADDI) {
+        processor->PC = pc + 4;
+        break;
+      }
+      R[e->rd] = R[e->rs1] + e->imm;
+      processor->PC = pc + 8;
+      processor->counters.instret++;
+      break;
+  }
+
+  // enforce x0 being hard-wired to 0
+  R[0] = 0;
+}
@@ -0,0 +1,23 @@
+#ifndef PREDECODE_H
+#define PREDECODE_H
+
+#include <stddef.h>
+#include "types.h"
+#include "image.h"
+
+/* Fills records, one per halfword of memory, with the size bytes of code
+   at base already decoded, and leaders, one byte per halfword, with where its
+   basic blocks start and which pairs of its instructions run as one.
+   For tables kept between runs, see image.c */
+void predecode_prepare(Decoded *records, Byte *leaders, Byte *memory, Address base, size_t size);
+
+/* Uses the tables of image, if there is one, and adds the blocks run to
+   its profile. With fuse set, common pairs of instructions run as one */
+void predecode_init(int fuse, const Image *image);
+void predecode_execute(Processor *, Byte *memory);
+void predecode_invalidate(Address address, Alignment alignment);
+
+/* Words decoded on first run, and records dropped by stores, for stats.c */
+extern Double predecode_misses, predecode_invalidations;
+
+#endif
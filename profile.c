@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/time.h>
+#include "profile.h"
+#include "riscv.h"
+#include "utils.h"
+#include "console.h"
+
+
+/* A statistical profile of the guest. SIGPROF comes rate times a second
+   of the CPU time the simulator uses, and its handler counts where each
+   hart's PC is, one counter per halfword of the image. Nothing is added
+   to the execute loop, so what it costs is the signals: at the default
+   rate, a few microseconds a second. The engines that run whole blocks
+   before storing the PC are seen where their blocks start. The kernel
+   sends SIGPROF no more often than its timer ticks, so asking for more
+   than a tick's worth a second gets no more samples.
+
+   Functions and blocks are only worked out at exit, from the image as
+   loaded. Blocks start at the image, at the targets of branches and
+   jal, and after any branch or jump. Functions start at the symbols
+   given or, without them, at the image and at each target of a jal that
+   links */
+
+typedef struct {
+  Address address;
+  char name[64];
+} Symbol;
+
+/* A function or a block, with the samples that fell in it */
+typedef struct {
+  Address start;
+  Word instructions;
+  Double samples;
+} Range;
+
+static Processor *harts;
+static int hart_count;
+static Address base;
+static Word slots, rate;
+static volatile Word *samples; // and one past the image for anywhere else
+static Byte *image;
+static const char *report_path;
+
+static Symbol *symbols;
+static int symbol_count, symbol_capacity;
+
+
+static void sample(int number) {
+  Word slot;
+  int i;
+  for (i = 0; i < hart_count; i++) {
+    slot = (harts[i].PC - base) >> 1;
+    samples[slot < slots ? slot : slots]++;
+  }
+}
+
+
+static void add_symbol(Address address, const char *name) {
+  if (symbol_count == symbol_capacity) {
+    symbol_capacity = symbol_capacity ? 2 * symbol_capacity : 64;
+    symbols = realloc(symbols, symbol_capacity * sizeof(Symbol));
+  }
+  symbols[symbol_count].address = address;
+  snprintf(symbols[symbol_count].name, sizeof(symbols[symbol_count].name), "%s", name);
+  symbol_count++;
+}
+
+
+/* The text symbols of nm's "address type name" lines */
+static void read_symbols(const char *filename) {
+  FILE *file = fopen(filename, "r");
+  char line[512], name[256], type;
+  unsigned address;
+
+  if (file == NULL) {
+    perror(filename);
+    exit(-1);
+  }
+  while (fgets(line, sizeof(line), file) != NULL) {
+    if (sscanf(line, "%x %c %255s", &address, &type, name) == 3 && (type == 'T' || type == 't')) {
+      add_symbol(address, name);
+    }
+  }
+  fclose(file);
+}
+
+
+static void decode_slot(Word slot, Decoded *decoded) {
+  Instruction instruction;
+  memcpy(&instruction.bits, image + 2 * slot, 4);
+  decode(instruction, decoded);
+}
+
+
+/* Marks where blocks start in leaders, and where jal calls go in calls */
+static void find_blocks(Byte *leaders, Byte *calls) {
+  Decoded d;
+  Word slot, target;
+
+  leaders[0] = calls[0] = 1;
+  for (slot = 0; slot < slots; slot += d.length / 2) {
+    decode_slot(slot, &d);
+    if (d.op != OP_jal && d.op != OP_jalr && d.op != OP_beq && d.op != OP_bne) continue;
+    if (d.op != OP_jalr) {
+      target = (2 * slot + d.imm) >> 1;
+      if (target < slots) {
+        leaders[target] = 1;
+        if (d.op == OP_jal && d.rd) calls[target] = 1;
+      }
+    }
+    if (slot + d.length / 2 < slots) leaders[slot + d.length / 2] = 1;
+  }
+}
+
+
+static int by_address(const void *a, const void *b) {
+  Address x = ((const Symbol *) a)->address, y = ((const Symbol *) b)->address;
+  return x < y ? -1 : x > y;
+}
+
+
+static int by_samples(const void *a, const void *b) {
+  const Range *x = a, *y = b;
+  if (x->samples != y->samples) return x->samples < y->samples ? 1 : -1;
+  return x->start < y->start ? -1 : x->start > y->start;
+}
+
+
+/* The symbol pc is in, the last at or below it */
+static const Symbol *symbol_of(Address pc) {
+  int low = 0, high = symbol_count - 1, middle;
+  while (low < high) {
+    middle = (low + high + 1) / 2;
+    if (symbols[middle].address <= pc) low = middle;
+    else high = middle - 1;
+  }
+  return &symbols[low];
+}
+
+
+/* Splits the image at each start, sums the samples and instructions
+   between them and sorts the ranges by samples. Returns how many */
+static Word gather(const Byte *starts, Range *ranges) {
+  Decoded d;
+  Word slot, count = 0;
+  Range *range = NULL;
+
+  for (slot = 0; slot < slots; slot++) {
+    if (starts[slot] || range == NULL) {
+      range = &ranges[count++];
+      range->start = base + 2 * slot;
+      range->instructions = range->samples = 0;
+      d.length = 0;
+    }
+    range->samples += samples[slot];
+    // instructions as the -d listing has them, from the start of the range
+    if (d.length <= 2) {
+      decode_slot(slot, &d);
+      range->instructions++;
+    } else {
+      d.length -= 2;
+    }
+  }
+  qsort(ranges, count, sizeof(Range), by_samples);
+  return count;
+}
+
+
+static void write_report(void) {
+  struct itimerval off = { { 0, 0 }, { 0, 0 } };
+  char line[DISASM_MAX_LINE], where[128];
+  Byte *leaders = calloc(slots + 1, 1), *calls = calloc(slots + 1, 1);
+  Range *ranges = malloc((slots + 1) * sizeof(Range));
+  const Symbol *symbol;
+  Decoded decoded;
+  Double total = samples[slots];
+  Word i, count, slot;
+  FILE *file;
+
+  setitimer(ITIMER_PROF, &off, NULL);
+  signal(SIGPROF, SIG_IGN);
+
+  if (strcmp(report_path, "-") == 0) {
+    console_flush();
+    file = stdout;
+  } else if ((file = fopen(report_path, "w")) == NULL) {
+    perror(report_path);
+    return;
+  }
+
+  find_blocks(leaders, calls);
+  if (symbol_count == 0) {
+    for (slot = 0; slot < slots; slot++) {
+      snprintf(where, sizeof(where), "%08x", base + 2 * slot);
+      if (calls[slot]) add_symbol(base + 2 * slot, where);
+    }
+  }
+  qsort(symbols, symbol_count, sizeof(Symbol), by_address);
+  if (symbol_count == 0 || symbols[0].address > base) {
+    add_symbol(base, "(image)");
+    qsort(symbols, symbol_count, sizeof(Symbol), by_address);
+  }
+  for (slot = 0; slot < slots; slot++) total += samples[slot];
+  fprintf(file, "%llu samples at %u a second from %d hart%s, %llu outside the image\n",
+          (unsigned long long) total, rate, hart_count, hart_count > 1 ? "s" : "", (unsigned long long) samples[slots]);
+  if (total == 0) total = 1;
+
+  // a function starts at each symbol in the image
+  memset(calls, 0, slots);
+  for (i = 0; i < symbol_count; i++) {
+    slot = (symbols[i].address - base) >> 1;
+    if (slot < slots) calls[slot] = 1;
+  }
+  count = gather(calls, ranges);
+  fprintf(file, "\n   samples      %%  function\n");
+  for (i = 0; i < count && ranges[i].samples; i++) {
+    fprintf(file, "%10llu %5.1f%%  %s\n", (unsigned long long) ranges[i].samples,
+            100.0 * ranges[i].samples / total, symbol_of(ranges[i].start)->name);
+  }
+
+  count = gather(leaders, ranges);
+  fprintf(file, "\n   samples      %%  %-33s %8s  %s\n", "block", "length", "first instruction");
+  for (i = 0; i < count && ranges[i].samples; i++) {
+    symbol = symbol_of(ranges[i].start);
+    if (ranges[i].start == symbol->address) snprintf(where, sizeof(where), "%s", symbol->name);
+    else snprintf(where, sizeof(where), "%s+0x%x", symbol->name, ranges[i].start - symbol->address);
+    decode_slot((ranges[i].start - base) >> 1, &decoded);
+    fprintf(file, "%10llu %5.1f%%  %08x %-24.24s %8u  %.*s\n", (unsigned long long) ranges[i].samples,
+            100.0 * ranges[i].samples / total, ranges[i].start, where, ranges[i].instructions,
+            (int) (disassemble_decoded(line, &decoded) - line - 1), line);
+  }
+  if (file != stdout) fclose(file);
+}
+
+
+void profile_init(Processor *processors, int count, Address start, Word size, Byte *memory,
+                  const char *filename, Word samples_per_second, const char *symbol_file) {
+  struct sigaction action;
+  struct itimerval timer;
+
+  harts = processors;
+  hart_count = count;
+  base = start;
+  slots = size / 2;
+  rate = samples_per_second;
+  report_path = filename;
+  samples = calloc(slots + 1, sizeof(Word));
+  if (symbol_file) read_symbols(symbol_file);
+
+  // as loaded, in case the program writes over itself
+  image = calloc(size + 4, 1);
+  memcpy(image, memory + base, size);
+  atexit(write_report);
+
+  // restarting whatever the signal lands in, the console's reads included
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = sample;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGPROF, &action, NULL);
+
+  timer.it_interval.tv_sec = 1 / rate;
+  timer.it_interval.tv_usec = rate > 1 ? 1000000 / rate : 0;
+  if (rate > 1000000) timer.it_interval.tv_usec = 1;
+  timer.it_value = timer.it_interval;
+  setitimer(ITIMER_PROF, &timer, NULL);
+}
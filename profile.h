@@ -0,0 +1,17 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "types.h"
+
+/* Samples per second of the simulator's CPU time, unless --profile-rate
+   says otherwise */
+#define PROFILE_DEFAULT_RATE 1000
+
+/* Starts sampling where count harts are in the size bytes at base, rate
+   times a second. At exit, writes how the samples fall into functions
+   and basic blocks to filename, or stdout for "-". symbols, if given, is
+   a symbol map as nm prints it, to name the functions by */
+void profile_init(Processor *harts, int count, Address base, Word size, Byte *memory,
+                  const char *filename, Word rate, const char *symbols);
+
+#endif
@@ -0,0 +1,213 @@
+#include <stdlib.h>
+#include <string.h>
+#include "replay.h"
+#include "riscv.h"
+#include "console.h"
+
+
+/* Record and replay for the interactive mode. Execution is deterministic
+   apart from the inputs logged through replay_input(), so a past state
+   is rebuilt from the nearest earlier snapshot by running forward again.
+
+   A snapshot holds the registers at its position plus the contents, as
+   of that position, of every page first written after it. Pages are
+   saved copy-on-first-write through PAGE_HOOK_UNDO, so memory is only
+   copied for pages a program actually writes. Restoring an older
+   snapshot undoes the newer ones in reverse order */
+
+typedef struct {
+  Address page;
+  Byte data[PAGE_SIZE];
+} SavedPage;
+
+typedef struct {
+  Double position;
+  Processor processor;
+  SavedPage *pages;
+  int count, capacity;
+} Snapshot;
+
+typedef struct {
+  Double position;
+  Word value;
+} Input;
+
+static int active;
+static Byte *memory;
+static Double position;   // instructions retired since the program started
+static Double high_water; // furthest position ever executed
+
+/* snapshots[first .. first + count - 1], oldest first, as a ring */
+static Snapshot snapshots[REPLAY_MAX_SNAPSHOTS];
+static int first, count;
+
+static Input *inputs;
+static size_t input_count, input_capacity, input_next;
+
+
+static Snapshot *snapshot(int i) {
+  return &snapshots[(first + i) % REPLAY_MAX_SNAPSHOTS];
+}
+
+
+static void watch_all_pages(void) {
+  int page;
+  for (page = 0; page < PAGE_COUNT; page++) page_hooks[page] |= PAGE_HOOK_UNDO;
+}
+
+
+static void take_snapshot(Processor *processor) {
+  Snapshot *s;
+  if (count == REPLAY_MAX_SNAPSHOTS) {
+    free(snapshot(0)->pages);
+    first = (first + 1) % REPLAY_MAX_SNAPSHOTS;
+    count--;
+  }
+  s = snapshot(count++);
+  s->position = position;
+  s->processor = *processor;
+  s->pages = NULL;
+  s->count = s->capacity = 0;
+  watch_all_pages();
+}
+
+
+void replay_save_page(Address page) {
+  Snapshot *s = snapshot(count - 1);
+  if (s->count == s->capacity) {
+    s->capacity = s->capacity ? 2 * s->capacity : 8;
+    s->pages = realloc(s->pages, s->capacity * sizeof(SavedPage));
+  }
+  s->pages[s->count].page = page;
+  memcpy(s->pages[s->count].data, memory + (page << PAGE_SHIFT), PAGE_SIZE);
+  s->count++;
+  page_hooks[page] &= ~PAGE_HOOK_UNDO;
+}
+
+
+/* Guest output was already shown the first time through */
+static void update_mute(void) {
+  console_mute(position < high_water);
+}
+
+
+void replay_init(Processor *processor, Byte *mem) {
+  active = 1;
+  memory = mem;
+  position = high_water = 0;
+  take_snapshot(processor);
+}
+
+
+void replay_tick(Processor *processor) {
+  position++;
+  if (position > high_water) high_water = position;
+  if (position - snapshot(count - 1)->position >= REPLAY_INTERVAL) take_snapshot(processor);
+  update_mute();
+}
+
+
+Double replay_position(void) {
+  return position;
+}
+
+
+/* Rewinds to snapshot i, dropping every snapshot after it */
+static void restore(Processor *processor, int i) {
+  Snapshot *s;
+  int j, k;
+
+  for (j = count - 1; j >= i; j--) {
+    s = snapshot(j);
+    for (k = s->count - 1; k >= 0; k--) {
+      memcpy(memory + (s->pages[k].page << PAGE_SHIFT), s->pages[k].data, PAGE_SIZE);
+    }
+    if (j > i) free(s->pages);
+  }
+  s = snapshot(i);
+  s->count = 0;
+  count = i + 1;
+  *processor = s->processor;
+  position = s->position;
+  watch_all_pages();
+
+  for (input_next = 0; input_next < input_count && inputs[input_next].position < position; input_next++);
+  update_mute();
+}
+
+
+/* Newest snapshot taken at or before target */
+static int snapshot_before(Double target) {
+  int i = count - 1;
+  while (i > 0 && snapshot(i)->position > target) i--;
+  return i;
+}
+
+
+static void run_to(Processor *processor, Double target) {
+  while (position < target) {
+    execute(processor, 0, 0);
+    replay_tick(processor);
+  }
+}
+
+
+/* Steps back one instruction. Returns 0 at the oldest recorded state */
+int replay_reverse_step(Processor *processor) {
+  Double target;
+  if (position == snapshot(0)->position) return 0;
+  target = position - 1;
+  restore(processor, snapshot_before(target));
+  run_to(processor, target);
+  return 1;
+}
+
+
+/* Goes back to the last time processor->PC was pc, before executing it.
+   Returns 0, left at the oldest recorded state, if it never was */
+int replay_reverse_continue(Processor *processor, Address pc) {
+  Double end = position, found;
+  int i, hit;
+
+  for (i = snapshot_before(end ? end - 1 : 0); i >= 0; i--) {
+    if (snapshot(i)->position >= end) continue;
+    restore(processor, i);
+    hit = 0;
+    found = 0;
+    while (position < end) {
+      if (processor->PC == pc) {
+        hit = 1;
+        found = position;
+      }
+      execute(processor, 0, 0);
+      replay_tick(processor);
+    }
+    if (hit) {
+      restore(processor, snapshot_before(found));
+      run_to(processor, found);
+      return 1;
+    }
+    end = snapshot(i)->position;
+  }
+  restore(processor, 0);
+  return 0;
+}
+
+
+int replay_input(Word *value) {
+  if (!active || input_next >= input_count || inputs[input_next].position != position) return 0;
+  *value = inputs[input_next++].value;
+  return 1;
+}
+
+
+void replay_record_input(Word value) {
+  if (!active) return;
+  if (input_count == input_capacity) {
+    input_capacity = input_capacity ? 2 * input_capacity : 64;
+    inputs = realloc(inputs, input_capacity * sizeof(Input));
+  }
+  inputs[input_count].position = position;
+  inputs[input_count].value = value;
+  input_next = ++input_count;
+}
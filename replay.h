@@ -0,0 +1,26 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "types.h"
+
+/* Instructions between snapshots. Reverse execution re-runs at most this
+   many instructions forward from the nearest snapshot */
+#define REPLAY_INTERVAL 100000
+
+/* Oldest snapshots are dropped beyond this, limiting how far back one
+   can go */
+#define REPLAY_MAX_SNAPSHOTS 4096
+
+void replay_init(Processor *, Byte *memory);
+void replay_tick(Processor *);
+Double replay_position(void);
+int replay_reverse_step(Processor *);
+int replay_reverse_continue(Processor *, Address pc);
+void replay_save_page(Address page);
+
+/* Nondeterministic inputs: a device asks replay_input() first and only
+   reads the real source when it returns 0, then logs what it read */
+int replay_input(Word *value);
+void replay_record_input(Word value);
+
+#endif
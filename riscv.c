@@ -1,9 +1,28 @@
 #include "riscv.h"
+#include "console.h"
+#include "disasm.h"
+#include "replay.h"
+#include "debug.h"
+#include "gdbstub.h"
+#include "hart.h"
+#include "coverage.h"
+#include "fuzz.h"
+#include "predecode.h"
+#include "cosim.h"
+#include "image.h"
+#include "aot.h"
+#include "bbv.h"
+#include "sample.h"
+#include "devices.h"
+#include "stats.h"
+#include "profile.h"
+#include "server.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <unistd.h>
 #include <stdarg.h>
+#include <getopt.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <string.h>
@@ -17,42 +36,232 @@
 Byte *memory;
 
 
-void execute(Processor *processor, int prompt, int print) {
+void print_registers(Processor *processor) {
+  int i,j,phase = stats_phase,bytes = 0;
+  stats_phase = STATS_TRACE;
+  for(i=0;i<8;i++) {
+    for(j=0;j<4;j++) {
+      bytes += printf("r%2d=%08x ",i*4+j,processor->R[i*4+j]);
+    }
+    puts("");
+  }
+  printf("\n");
+  stats_trace_bytes += bytes + 9;
+  stats_phase = phase;
+}
+
+
+static const char *help =
+  "enter            step one instruction\n"
+  "c                continue until a breakpoint, watchpoint or condition\n"
+  "b/db <pc>        set/delete a breakpoint\n"
+  "w <addr> [len]   stop after stores to len bytes at addr (default 4)\n"
+  "dw <addr>        delete the watchpoints at addr\n"
+  "cond xN <op> v   stop when xN <op> v becomes true (== != < <= > >=)\n"
+  "dcond            delete all conditions\n"
+  "l                list breakpoints, watchpoints and conditions\n"
+  "r                print the registers\n"
+  "rs               step back one instruction\n"
+  "rc <pc>          run back to the last time PC was pc\n"
+  "q                quit\n"
+  "addresses are hex, values decimal or 0x-prefixed hex\n";
+
+
+static int parse_comparison(const char *text, Comparison *comparison) {
+  static const char *names[] = { "==", "!=", "<", "<=", ">", ">=" };
+  int i;
+  for (i = 0; i < 6; i++) {
+    if (strcmp(text, names[i]) == 0) {
+      *comparison = i;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+/* Interactive-mode commands, read until the user lets the simulator go on.
+   Going back re-executes from a snapshot, see replay.c */
+void pause_prompt(Processor *processor) {
+  char line[64], op[4], value[24];
+  Address address;
+  unsigned int reg;
+  int length;
+  Comparison comparison;
   Instruction instruction;
 
-  /* fetch an instruction */
-  instruction.bits = load(memory, processor->PC, LENGTH_WORD, 1);
+  while (1) {
+    printf("simulator paused,enter to continue...");
+    if (fgets(line, sizeof(line), stdin) == NULL || line[0] == '\n') {
+      debug_stepping = 1;
+      return;
+    }
 
-  /* interactive-mode prompt */
-  if (prompt) {
-    if (prompt == 1) {
-      printf("simulator paused,enter to continue...");
-      while(getchar() != '\n');
+    if (strcmp(line, "c\n") == 0) {
+      debug_stepping = 0;
+      return;
+    } else if (strcmp(line, "q\n") == 0) {
+      exit(0);
+    } else if (sscanf(line, "b %x", &address) == 1) {
+      if (!debug_add_breakpoint(address)) printf("no instruction can be at %08x\n", address);
+    } else if (sscanf(line, "db %x", &address) == 1) {
+      if (!debug_remove_breakpoint(address)) printf("no breakpoint at %08x\n", address);
+    } else if (sscanf(line, "w %x %i", &address, &length) >= 1) {
+      if (sscanf(line, "w %*x %i", &length) != 1) length = 4;
+      if (!debug_add_watchpoint(address, length)) printf("cannot watch %d bytes at %08x\n", length, address);
+    } else if (sscanf(line, "dw %x", &address) == 1) {
+      if (!debug_remove_watchpoint(address)) printf("no watchpoint at %08x\n", address);
+    } else if (sscanf(line, "cond x%u %3s %23s", &reg, op, value) == 3 && parse_comparison(op, &comparison)) {
+      if (!debug_add_condition(processor, reg, comparison, strtoll(value, NULL, 0))) printf("cannot add that condition\n");
+    } else if (strcmp(line, "dcond\n") == 0) {
+      debug_clear_conditions();
+    } else if (strcmp(line, "l\n") == 0) {
+      debug_list();
+    } else if (strcmp(line, "r\n") == 0) {
+      print_registers(processor);
+    } else if (strcmp(line, "rs\n") == 0 || sscanf(line, "rc %x", &address) == 1) {
+      if (line[1] == 's') {
+        if (!replay_reverse_step(processor)) printf("already at the oldest recorded state\n");
+      } else if (!replay_reverse_continue(processor, address)) {
+        printf("%08x was not reached, back at the oldest recorded state\n", address);
+      }
+      // re-execution may have crossed watchpoints
+      debug_stop = 0;
+      printf("[%llu] %08x: ", (unsigned long long) replay_position(), processor->PC);
+      instruction.bits = fetch(memory, processor->PC);
+      decode_instruction(instruction);
+    } else {
+      fputs(help, stdout);
     }
-    printf("%08x: ", processor->PC);
-    decode_instruction(instruction);
   }
+}
 
-  execute_instruction(instruction, processor, memory);
+
+/* The run loop is compiled once for each set of these, so a plain run
+   tests for none of them and a new diagnostic costs nothing until it is
+   asked for. Within a set, the options it covers are still tested */
+#define RUN_INTERACTIVE 1 // -i: the prompt, breakpoints, conditions and replay
+#define RUN_TRACE 2       // -t and -r: disassembly and register dumps
+#define RUN_PROFILE 4     // -c, -b and --stats: counts per instruction
+
+#define RUN_VARIANTS(X) X(0) X(1) X(2) X(3) X(4) X(5) X(6) X(7)
+
+static int trace_disassembly, trace_registers;
+static Address last_pc;
+
+/* Each thread that runs the loop keeps what it decoded, one record per
+   halfword of memory. A record is used while memory still holds the bits
+   it was decoded from, so stores, the gdb stub, replay, the fuzzer and
+   the server can change memory without telling it. A zeroed record is
+   what the invalid halfword 0000 decodes to, as far as execute_decoded()
+   reads it */
+static __thread Decoded *decoded_cache;
+
+
+static inline __attribute__((always_inline)) void step(Processor *processor, const int features) {
+  Instruction instruction;
+  Decoded *decoded;
+  Address pc;
+  char line[DISASM_MAX_LINE];
+
+  /* interactive-mode prompt, before the fetch since it can move the PC */
+  if ((features & RUN_INTERACTIVE) && debug_should_pause(processor)) {
+    if (features & RUN_PROFILE) stats_phase = STATS_OTHER;
+    if (!debug_stepping) {
+      if (debug_breakpoint_at(processor->PC)) printf("breakpoint at %08x\n", processor->PC);
+      debug_report(last_pc);
+    }
+    pause_prompt(processor);
+  }
+
+  /* fetch an instruction */
+  if (features & RUN_PROFILE) stats_phase = STATS_FETCH;
+  instruction.bits = fetch(memory, processor->PC);
+
+  if (((features & RUN_TRACE) && trace_disassembly) || ((features & RUN_INTERACTIVE) && debug_stepping)) {
+    stats_phase = STATS_TRACE;
+    stats_trace_bytes += printf("%08x: ", processor->PC);
+    stats_trace_bytes += fwrite(line, 1, disassemble(line, instruction) - line, stdout);
+  }
+
+  /* decode and execute it, apart so --stats can tell them apart */
+  pc = processor->PC;
+  if (features & RUN_INTERACTIVE) last_pc = pc;
+  if (features & RUN_PROFILE) {
+    stats_phase = STATS_DECODE;
+    if (coverage_counts) coverage_start(pc);
+  }
+  decoded = &decoded_cache[pc >> 1];
+  if (decoded->bits != instruction.bits) decode(instruction, decoded);
+  if (features & (RUN_PROFILE | RUN_TRACE | RUN_INTERACTIVE)) stats_phase = STATS_EXECUTE;
+  execute_decoded(decoded, processor, memory);
+  if (features & RUN_PROFILE) {
+    if (coverage_counts) coverage_hit(pc, processor->PC, decoded->length);
+    if (bbv_interval) bbv_hit(pc, processor->PC, decoded->length);
+  }
 
   // enforce x0 being hard-wired to 0
   processor->R[0] = 0;
 
+  if (features & RUN_INTERACTIVE) {
+    replay_tick(processor);
+    if (debug_condition_count) debug_check_conditions(processor);
+  }
+
   // print trace
-  if(print) {
-    int i,j;
-    for(i=0;i<8;i++) {
-      for(j=0;j<4;j++) {
-        printf("r%2d=%08x ",i*4+j,processor->R[i*4+j]);
-      }
-      puts("");
-    }
-    printf("\n");
+  if ((features & (RUN_TRACE | RUN_INTERACTIVE)) && trace_registers) print_registers(processor);
+}
+
+
+#define RUN_LOOP(features) \
+  static void run_##features(Processor *processor, Word steps) { \
+    if (!decoded_cache) decoded_cache = calloc(CODE_SLOTS, sizeof(Decoded)); \
+    if (steps == RUN_FOREVER) { \
+      while (1) step(processor, features); \
+    } \
+    while (steps--) step(processor, features); \
   }
+RUN_VARIANTS(RUN_LOOP)
+#undef RUN_LOOP
+
+#define RUN_ENTRY(features) run_##features,
+static const Runner runners[] = { RUN_VARIANTS(RUN_ENTRY) };
+#undef RUN_ENTRY
+
+
+Runner run_loop(int prompt, int print) {
+  int features = 0;
+
+  trace_disassembly = prompt == 2;
+  trace_registers = print;
+  if (prompt == 1) features |= RUN_INTERACTIVE;
+  if (prompt == 2 || print) features |= RUN_TRACE;
+  if (coverage_counts || bbv_interval || stats_running) features |= RUN_PROFILE;
+  return runners[features];
 }
 
 
-void load_program(uint8_t *mem, size_t memsize, int startaddr, const char *filename, int disasm) {
+/* One instruction. The trace settings are left as they were, since replay
+   and the gdb stub step through here under a runner of their own */
+void execute(Processor *processor, int prompt, int print) {
+  int disassembly = trace_disassembly, registers = trace_registers;
+  run_loop(prompt, print)(processor, 1);
+  trace_disassembly = disassembly;
+  trace_registers = registers;
+}
+
+
+/* The reference engine, execute() without the extras */
+void interpret(Processor *processor, Byte *memory) {
+  Instruction instruction;
+  instruction.bits = fetch(memory, processor->PC);
+  execute_instruction(instruction, processor, memory);
+  processor->R[0] = 0;
+}
+
+
+/* Returns the number of bytes loaded */
+size_t load_program(uint8_t *mem, size_t memsize, int startaddr, const char *filename, int disasm) {
   FILE *file = fopen(filename, "r");
   const int MAX_SIZE = 50;
   char line[MAX_SIZE];
@@ -71,19 +280,42 @@ void load_program(uint8_t *mem, size_t memsize, int startaddr, const char *filen
     }
     offset += 4;
   }
+  return offset;
 }
 
 
+/* Options with no letter, getopt_long() values past any character */
+enum { OPT_STATS = 256, OPT_STATS_FILE, OPT_STATS_PERIOD, OPT_PROFILE, OPT_PROFILE_RATE, OPT_PROFILE_SYMBOLS, OPT_SERVE };
+
+static const struct option long_options[] = {
+  { "stats", no_argument, NULL, OPT_STATS },
+  { "stats-file", required_argument, NULL, OPT_STATS_FILE },
+  { "stats-period", required_argument, NULL, OPT_STATS_PERIOD },
+  { "profile", required_argument, NULL, OPT_PROFILE },
+  { "profile-rate", required_argument, NULL, OPT_PROFILE_RATE },
+  { "profile-symbols", required_argument, NULL, OPT_PROFILE_SYMBOLS },
+  { "serve", required_argument, NULL, OPT_SERVE },
+  { NULL, 0, NULL, 0 }
+};
+
+
 int main(int argc, char **argv) {
   /* options */
-  int opt_disasm = 0, opt_regdump = 0, opt_interactive = 0;
+  int opt_disasm = 0, opt_regdump = 0, opt_interactive = 0, opt_harts = 1, opt_engine = 0, opt_hot = 0;
+  int opt_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  Word opt_quantum = 0;
+  const char *opt_gdb = NULL, *opt_coverage = NULL, *opt_fuzz = NULL, *opt_input = NULL, *opt_cache = NULL, *opt_aot = NULL;
+  const char *opt_bbv = NULL, *opt_points = NULL, *opt_disk = NULL, *opt_stats_file = NULL;
+  const char *opt_profile = NULL, *opt_profile_symbols = NULL, *opt_serve = NULL;
+  Word opt_interval = BBV_DEFAULT_INTERVAL, opt_stats_period = STATS_DEFAULT_PERIOD, opt_profile_rate = PROFILE_DEFAULT_RATE;
+  int opt_stats = 0;
 
-  /* the architectural state of the CPU */
-  Processor processor;
+  /* the architectural state of each hart */
+  Processor harts[HART_MAX];
 
   /* parse the command-line args */
   int c;
-  while ((c = getopt(argc, argv, "drit")) != -1) {
+  while ((c = getopt_long(argc, argv, "dritj:g:p:q:c:f:F:ECA:SK:H:b:n:P:D:", long_options, NULL)) != -1) {
     switch (c) {
       case 'd':
         opt_disasm = 1;
@@ -97,6 +329,77 @@ int main(int argc, char **argv) {
       case 't':
         opt_interactive = 2;
         break;
+      case 'j':
+        opt_threads = atoi(optarg);
+        break;
+      case 'g':
+        opt_gdb = optarg;
+        break;
+      case 'p':
+        opt_harts = atoi(optarg);
+        break;
+      case 'q':
+        opt_quantum = atoi(optarg);
+        break;
+      case 'c':
+        opt_coverage = optarg;
+        break;
+      case 'f':
+        opt_fuzz = optarg;
+        break;
+      case 'F':
+        opt_input = optarg;
+        break;
+      case 'E':
+      case 'C':
+        opt_engine = c;
+        break;
+      case 'A':
+        opt_aot = optarg;
+        if (opt_engine != 'C') opt_engine = c;
+        break;
+      case 'S':
+        opt_cache = IMAGE_CACHE_DIR;
+        break;
+      case 'K':
+        opt_cache = optarg;
+        break;
+      case 'H':
+        opt_hot = atoi(optarg);
+        break;
+      case 'b':
+        opt_bbv = optarg;
+        break;
+      case 'n':
+        opt_interval = strtoul(optarg, NULL, 0);
+        break;
+      case 'P':
+        opt_points = optarg;
+        break;
+      case 'D':
+        opt_disk = optarg;
+        break;
+      case OPT_STATS:
+        opt_stats = 1;
+        break;
+      case OPT_STATS_FILE:
+        opt_stats_file = optarg;
+        break;
+      case OPT_STATS_PERIOD:
+        opt_stats_period = strtoul(optarg, NULL, 0);
+        break;
+      case OPT_PROFILE:
+        opt_profile = optarg;
+        break;
+      case OPT_PROFILE_RATE:
+        opt_profile_rate = strtoul(optarg, NULL, 0);
+        break;
+      case OPT_PROFILE_SYMBOLS:
+        opt_profile_symbols = optarg;
+        break;
+      case OPT_SERVE:
+        opt_serve = optarg;
+        break;
       default:
         fprintf(stderr, "Bad option %c\n", c);
         return -1;
@@ -104,36 +407,146 @@ int main(int argc, char **argv) {
   }
 
   /* make sure we got an executable filename on the command line */
-  if (argc <= optind) {
+  if (argc <= optind && !opt_serve) {
     fprintf(stderr, "Give me an executable file to run!\n");
     return -1;
   }
 
-  /* load the executable into memory */
+  if (opt_harts < 1 || opt_harts > HART_MAX) {
+    fprintf(stderr, "Can simulate 1 to %d harts\n", HART_MAX);
+    return -1;
+  }
+  if (opt_harts > 1 && (opt_interactive == 1 || opt_gdb)) {
+    fprintf(stderr, "Can only debug a single hart\n");
+    return -1;
+  }
+  if (opt_engine && (opt_harts > 1 || opt_interactive || opt_gdb || opt_fuzz)) {
+    fprintf(stderr, "-E, -C and -A run a single hart, without -i, -t, -g or -f\n");
+    return -1;
+  }
+  if (opt_engine && opt_coverage) {
+    fprintf(stderr, "-c counts what the interpreter runs, without -E, -C or -A\n");
+    return -1;
+  }
+  if ((opt_bbv || opt_points) && (opt_harts > 1 || opt_engine || opt_interactive == 1 || opt_gdb || opt_fuzz)) {
+    fprintf(stderr, "-b and -P run a single hart, without -E, -C, -A, -i, -g or -f\n");
+    return -1;
+  }
+  if (opt_interval == 0) {
+    fprintf(stderr, "-n needs at least one instruction per interval\n");
+    return -1;
+  }
+  if (opt_stats_period == 0) {
+    fprintf(stderr, "--stats-period needs at least a millisecond\n");
+    return -1;
+  }
+  if (opt_profile_rate == 0) {
+    fprintf(stderr, "--profile-rate needs at least one sample a second\n");
+    return -1;
+  }
+  if (opt_engine == 'A' && opt_regdump) {
+    fprintf(stderr, "-A runs whole blocks, -r needs -C as well\n");
+    return -1;
+  }
+
+  /* traces must come out the same every run, so harts take turns */
+  if ((opt_regdump || opt_interactive) && !opt_quantum) opt_quantum = HART_DEFAULT_QUANTUM;
+
+  /* disassembling never needs the simulator, so stream it straight out */
+  if (opt_disasm) return disassemble_file(argv[optind], 0x1000, opt_threads);
+
+  /* load the executable into memory, shared with other runs of it if asked */
+  Image image = { NULL, NULL, 0 };
   assert(memory == NULL);
-  memory = calloc(MEMORY_SPACE, sizeof(uint8_t)); // allocate zeroed memory
-  assert(memory != NULL);
+  if (opt_cache && image_map(&image, argv[optind], 0x1000, opt_cache)) {
+    memory = image.memory;
+  } else {
+    memory = calloc(MEMORY_SPACE, sizeof(uint8_t)); // allocate zeroed memory
+    assert(memory != NULL);
+  }
 
-  /* set the PC to 0x1000 */
-  processor.PC = 0x1000;
-  load_program(memory, MEMORY_SPACE, processor.PC, argv[optind], opt_disasm);
+  /* guest output can be batched unless the host interleaves its own */
+  if (opt_regdump || opt_interactive || opt_gdb) console_init(CONSOLE_FLUSH_ALWAYS);
+  else if (isatty(STDOUT_FILENO)) console_init(CONSOLE_FLUSH_LINE);
+  else console_init(CONSOLE_FLUSH_FULL);
 
-  /* if we're just disassembling,exit here */
-  if (opt_disasm) return 0;
+  /* or run whichever programs are sent, many to a process */
+  if (opt_serve) {
+    devices_init(NULL);
+    server_run(memory, opt_serve, opt_threads);
+  }
+
+  size_t size = image.memory ? image.size : load_program(memory, MEMORY_SPACE, 0x1000, argv[optind], opt_disasm);
 
-  /* initialize the CPU */
-  /* zero out all registers */
+  /* what the predecoding engine ran in earlier runs of this image */
+  if (opt_hot) {
+    if (!image.memory) {
+      fprintf(stderr, "-H needs the image cache, -S or -K\n");
+      return -1;
+    }
+    image_print_profile(&image, stdout, opt_hot);
+    return 0;
+  }
+
+  /* memory-mapped devices past the end of RAM */
+  devices_init(opt_disk);
+
+  /* count what runs, listed at exit */
+  if (opt_coverage) coverage_init(0x1000, size, memory, opt_coverage);
+
+  /* basic-block vectors for tools/rvsimpoint */
+  if (opt_bbv) bbv_init(opt_interval, 0x1000, opt_bbv);
+
+  /* initialize the CPUs */
   int i;
-  for (i = 0; i < 32; i++) processor.R[i] = 0;
+  for (i = 0; i < opt_harts; i++) hart_reset(&harts[i], i);
+
+  /* watch the simulator itself from here on */
+  if (opt_stats || opt_stats_file) {
+    stats_init(harts, opt_harts, opt_stats, opt_stats_file, opt_stats_period, opt_engine == 'E' || (opt_engine == 'C' && !opt_aot));
+  }
+  stats_phase = STATS_EXECUTE;
+
+  /* and where in the guest the time goes, by sampling */
+  if (opt_profile) profile_init(harts, opt_harts, 0x1000, size, memory, opt_profile, opt_profile_rate, opt_profile_symbols);
+
+  /* a fuzz input, e.g. to reproduce a crash the fuzzer found */
+  if (opt_input && !fuzz_load_input(&harts[0], memory, opt_input)) {
+    perror(opt_input);
+    return -1;
+  }
+
+  /* or keep running it on new ones */
+  if (opt_fuzz) fuzz_run(&harts[0], memory, size, opt_fuzz);
+
+  /* the predecoding engine or a translation from tools/rvaot, alone or
+     checked against the interpreter. A register dump per instruction
+     rules out fused pairs, except under -C where the reference prints it */
+  Engine engine = predecode_execute;
+  if (opt_aot) {
+    aot_init(opt_aot, memory);
+    engine = aot_execute;
+  } else if (opt_engine) {
+    predecode_init(opt_engine == 'C' || !opt_regdump, image.memory ? &image : NULL);
+  }
+  if (opt_engine == 'C') cosim_run(&harts[0], memory, engine, opt_aot ? "aot" : "predecode", opt_regdump);
+  if (opt_engine == 'A') aot_run(&harts[0], memory);
+  while (opt_engine == 'E') {
+    predecode_execute(&harts[0], memory);
+    if (opt_regdump) print_registers(&harts[0]);
+  }
+
+  /* or only the simulation points tools/rvsimpoint picked, in detail */
+  if (opt_points) sample_run(&harts[0], memory, opt_points, opt_interactive, opt_regdump);
 
-  /* Set the global pointer to 0x3000. We arbitrarily call this the middle of the static data segment */
-  processor.R[3] = 0x3000;
+  /* record the run so interactive mode can go backwards */
+  if (opt_interactive == 1) replay_init(&harts[0], memory);
 
-  /* Set the stack pointer near the top of the memory array */
-  processor.R[2] = 0xEFFFF;
+  /* or let gdb drive it */
+  if (opt_gdb) gdbstub_run(&harts[0], memory, opt_gdb);
 
   /* simulate forever! */
-  while (1) execute(&processor,opt_interactive, opt_regdump);
+  harts_run(harts, opt_harts, opt_quantum, opt_interactive, opt_regdump);
 
   return 0;
 }
@@ -1,14 +1,58 @@
 #ifndef RISCV_H
 #define RISCV_H
 
+#include <stddef.h>
 #include "types.h"
+#include "isa.h"
+
+/* Guest memory is tracked in pages for the store hooks */
+#define PAGE_SHIFT 12
+#define PAGE_SIZE (1 << PAGE_SHIFT)
+#define PAGE_COUNT (MEMORY_SPACE >> PAGE_SHIFT)
+
+/* Bits in page_hooks[], one per subsystem that needs to see stores */
+#define PAGE_HOOK_UNDO 0x01 /* replay.c: save the page before its first write */
+#define PAGE_HOOK_WATCH 0x02 /* debug.c: the page holds a watchpoint */
+#define PAGE_HOOK_DIRTY 0x04 /* fuzz.c: restore the page before the next run */
+#define PAGE_HOOK_CODE 0x08 /* predecode.c: the page holds decoded instructions */
+#define PAGE_HOOK_COSIM 0x10 /* cosim.c: log every store */
+#define PAGE_HOOK_AOT 0x20 /* aot.c: the page holds translated code */
+
+/* Instructions can start on any halfword, so tables of what is at each
+   instruction have this many entries */
+#define CODE_SLOTS (MEMORY_SPACE / 2)
+
+/* Processor.reservation when the hart holds no LR reservation */
+#define NO_RESERVATION 0xffffffff
+
+/* An execution engine: runs the next instruction on the hart */
+typedef void (*Engine)(Processor *, Byte *memory);
+
+/* A run loop: runs steps instructions on the hart, or with RUN_FOREVER
+   until the simulation ends */
+typedef void (*Runner)(Processor *, Word steps);
+#define RUN_FOREVER 0
+
+/* see riscv.c */
+Runner run_loop(int prompt, int print);
+void execute(Processor *processor, int prompt, int print);
+void interpret(Processor *processor, Byte *memory);
+void print_registers(Processor *processor);
+size_t load_program(Byte *mem, size_t memsize, int startaddr, const char *filename, int disasm);
 
 /* see part1.c */
 void decode_instruction(Instruction i);
+char *disassemble(char *out, Instruction i);
+char *disassemble_decoded(char *out, const Decoded *d);
 
 /* see part2.c */
 void execute_instruction(Instruction instruction, Processor* processor, Byte *memory);
+void execute_decoded(const Decoded *decoded, Processor *processor, Byte *memory);
+int check(Address address, Alignment alignment);
+extern Byte page_hooks[PAGE_COUNT];
+void store_hook(Address address, Alignment alignment);
 void store(Byte *memory, Address address, Alignment alignment, Word value, int);
 Word load(Byte *memory, Address address, Alignment alignment, int);
+Word fetch(Byte *memory, Address pc);
 
 #endif
@@ -0,0 +1,84 @@
+######################
+#     amo TESTS      #
+######################
+
+.globl __start
+
+.text
+
+__start:
+  li t0, -5
+  sw t0, 0(gp)
+
+test01:
+  li a1, 1
+  li t1, 7
+  amoadd.w x30, t1, (gp)
+  li x29, -5
+  bne x30, x29, fail
+  lw x30, 0(gp)
+  li x29, 2
+  bne x30, x29, fail
+
+test02:
+  li a1, 2
+  li t1, -9
+  amomin.w x30, t1, (gp)
+  lw x30, 0(gp)
+  li x29, -9
+  bne x30, x29, fail
+
+test03:
+  li a1, 3
+  li t1, 3
+  amominu.w x30, t1, (gp)
+  lw x30, 0(gp)
+  li x29, 3
+  bne x30, x29, fail
+
+test04:
+  li a1, 4
+  li t1, -1
+  amomax.w x30, t1, (gp)
+  lw x30, 0(gp)
+  li x29, 3
+  bne x30, x29, fail
+  amomaxu.w x30, t1, (gp)
+  lw x30, 0(gp)
+  li x29, -1
+  bne x30, x29, fail
+
+test05:
+  li a1, 5
+  li t1, 0x0ff0
+  amoand.w x30, t1, (gp)
+  li t1, 0x7000
+  amoor.w x30, t1, (gp)
+  li t1, 0x00f0
+  amoxor.w x30, t1, (gp)
+  li t1, 42
+  amoswap.w x30, t1, (gp)
+  li x29, 0x7f00
+  bne x30, x29, fail
+
+test06:
+  li a1, 6
+  lr.w x30, (gp)
+  addi x30, x30, 1
+  sc.w x31, x30, (gp)
+  bne x31, x0, fail
+  sc.w x31, x30, (gp)
+  beq x31, x0, fail
+  lw x30, 0(gp)
+  li x29, 43
+  bne x30, x29, fail
+
+success:
+  li a0, 10
+  ecall
+
+fail:
+  li a0, 1
+  ecall
+  li a0, 10
+  ecall
@@ -0,0 +1,60 @@
+######################
+#     call TESTS     #
+######################
+
+# call and tail are auipc and jalr pairs, the call's with rd == rs1
+
+.globl __start
+
+.text
+
+__start:
+
+test01:
+  li a1, 1
+  call f
+return_1:
+  li x29, 42
+  bne t0, x29, fail
+  la x29, return_1
+  bne ra, x29, fail
+
+test02:
+  li a1, 2
+  jal ra, tailer
+return_2:
+  li x29, 7
+  bne t0, x29, fail
+  la x29, return_2
+  bne ra, x29, fail
+
+test03:
+  li a1, 3
+  li tp, 0
+1:
+  call f
+  addi tp, tp, 1
+  li x29, 2
+  bne tp, x29, 1b
+  li x29, 0
+
+success:
+  li a0, 10
+  ecall
+
+fail:
+  li a0, 1
+  ecall
+  li a0, 10
+  ecall
+
+f:
+  li t0, 42
+  ret
+
+tailer:
+  tail g
+
+g:
+  li t0, 7
+  ret
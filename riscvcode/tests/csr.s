@@ -0,0 +1,76 @@
+######################
+#     csr TESTS      #
+######################
+
+.globl __start
+
+.text
+
+__start:
+
+test01:
+  li a1, 1
+  rdinstret x30
+  rdinstret x29
+  addi x30, x30, 1
+  bne x30, x29, fail
+  rdcycle x30
+  addi x29, x29, 3
+  bne x30, x29, fail
+
+test02:
+  li a1, 2
+  csrwi mhpmevent3, 1
+  csrw mhpmcounter3, x0
+  lw x30, 0(gp)
+  lw x30, 0(gp)
+  sw x30, 0(gp)
+  csrr x30, hpmcounter3
+  li x29, 2
+  bne x30, x29, fail
+
+test03:
+  li a1, 3
+  csrwi mhpmevent4, 3
+  li x28, 5
+loop:
+  addi x28, x28, -1
+  bne x28, x0, loop
+  beq x28, x28, taken
+taken:
+  csrr x30, hpmcounter4
+  li x29, 5
+  bne x30, x29, fail
+
+test04:
+  li a1, 4
+  csrwi mhpmevent5, 4
+  mul x30, x28, x28
+  rem x30, x28, x29
+  csrrci x30, mhpmevent5, 4
+  li x29, 4
+  bne x30, x29, fail
+  csrr x30, mhpmcounter5
+  li x29, 2
+  bne x30, x29, fail
+  csrr x30, mhpmevent5
+  bne x30, x0, fail
+
+test05:
+  li a1, 5
+  li x29, -1
+  csrw minstreth, x29
+  csrr x30, instreth
+  bne x30, x29, fail
+  csrr x30, mhartid
+  bne x30, x0, fail
+
+success:
+  li a0, 10
+  ecall
+
+fail:
+  li a0, 1
+  ecall
+  li a0, 10
+  ecall
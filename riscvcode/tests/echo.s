@@ -0,0 +1,27 @@
+######################
+#     echo TESTS     #
+######################
+
+# Copies what the UART receives to what it sends, until the line status
+# says standard input has ended
+
+.globl __start
+
+.text
+
+__start:
+  li x5, 0x10000000
+
+wait:
+  lb x6, 5(x5)
+  andi x7, x6, 0x01
+  bne x7, x0, copy
+  andi x7, x6, 0x10
+  beq x7, x0, wait
+  li a0, 10
+  ecall
+
+copy:
+  lb x6, 0(x5)
+  sb x6, 0(x5)
+  j wait
@@ -0,0 +1,37 @@
+######################
+#    harts TESTS     #
+######################
+
+# run with -p 4: hart n adds n + 1 to a shared counter ten times, then
+# counts itself done; hart 0 waits for all four and prints the total,
+# 10 * (1 + 2 + 3 + 4) = 100
+
+.globl __start
+
+.text
+
+__start:
+  addi t1, a0, 1
+  li t2, 10
+1:
+  amoadd.w x0, t1, (gp)
+  addi t2, t2, -1
+  bne t2, x0, 1b
+  li t1, 1
+  addi t3, gp, 4
+  amoadd.w x0, t1, (t3)
+  bne a0, x0, idle
+
+wait:
+  lw t0, 4(gp)
+  li x29, 4
+  bne t0, x29, wait
+
+  lw a1, 0(gp)
+  li a0, 1
+  ecall
+  li a0, 10
+  ecall
+
+idle:
+  j idle
@@ -0,0 +1,47 @@
+######################
+#     mmio TESTS     #
+######################
+
+.globl __start
+
+.text
+
+__start:
+
+test01:
+  li x5, 0x10000000
+  li x6, 79
+  sb x6, 0(x5)
+  li x6, 75
+  sb x6, 0(x5)
+  li x6, 10
+  sw x6, 0(x5)
+
+test02:
+  li x5, 0x10001000
+  sw x0, 8(x5)
+  sw x0, 12(x5)
+  lw x30, 16(x5)
+  li x29, 1
+  bne x30, x29, fail
+  lw x30, 12(x5)
+  bne x30, x0, fail
+  li x6, -1
+  sw x6, 12(x5)
+  lw x30, 16(x5)
+  bne x30, x0, fail
+  lh x30, 14(x5)
+  li x29, -1
+  bne x30, x29, fail
+  li x30, 0
+  li x29, 0
+
+success:
+  li a0, 10
+  ecall
+
+fail:
+  li a0, 1
+  ecall
+  li a0, 10
+  ecall
@@ -0,0 +1,27 @@
+######################
+#    parse TESTS     #
+######################
+
+# A parser for riscv -f to fuzz: a1 holds the input and a2 its length.
+# Inputs that start with "RV" read from outside memory, a crash
+
+.globl __start
+
+.text
+
+__start:
+  beq a2, x0, done
+  lb t0, 0(a1)
+  li t1, 82
+  bne t0, t1, done
+  li t1, 1
+  beq a2, t1, done
+  lb t0, 1(a1)
+  li t1, 86
+  bne t0, t1, done
+  li t2, 0x7ffff000
+  lw t0, 0(t2)
+
+done:
+  li a0, 10
+  ecall
@@ -0,0 +1,29 @@
+######################
+#   rewrite TESTS    #
+######################
+
+# Writes over its own code: the second time round the loop, the addi
+# after the sw has become addi x7, x0, 99, which is what gets printed.
+# -E runs it, -A must refuse
+
+.globl __start
+
+.text
+
+__start:
+  auipc x5, 0
+  lw x6, 44(x5)
+  addi x8, x5, 20
+  addi x9, x0, 2
+
+loop:
+  sw x6, 0(x8)
+  addi x7, x0, 1
+  addi x9, x9, -1
+  bne x9, x0, loop
+  addi x11, x7, 0
+  addi x10, x0, 1
+  ecall
+  addi x7, x0, 99
+  addi x10, x0, 10
+  ecall
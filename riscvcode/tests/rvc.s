@@ -0,0 +1,92 @@
+######################
+#     rvc TESTS      #
+######################
+
+# assembled with the C extension: llvm-mc -mattr=+m,+c
+
+.globl __start
+
+.text
+
+__start:
+
+test01:
+  c.li a1, 1
+  c.li a0, 5
+  c.addi a0, -1
+  c.li x29, 4
+  bne a0, x29, fail
+  c.mv a2, a0
+  c.add a2, a0
+  c.li x29, 8
+  bne a2, x29, fail
+  c.nop
+
+test02:
+  c.li a1, 2
+  c.addi16sp sp, -32
+  c.addi4spn s0, sp, 16
+  c.sw a2, 4(s0)
+  c.lw a3, 4(s0)
+  c.swsp a3, 8(sp)
+  c.lwsp a4, 8(sp)
+  bne a4, a2, fail
+  c.addi16sp sp, 32
+
+test03:
+  c.li a1, 3
+  c.lui a5, 0x12
+  c.srli a5, 3
+  c.srai a5, 1
+  c.andi a5, 0xf
+  c.slli a5, 2
+  bne a5, x0, fail
+  c.li a3, 6
+  c.li a4, 3
+  c.sub a3, a4
+  c.xor a3, a2
+  c.or a3, a4
+  c.and a3, a2
+  c.li x29, 8
+  bne a3, x29, fail
+
+test04:
+  c.li a1, 4
+  c.li a2, 0
+  c.bnez a2, fail
+  c.beqz a2, 1f
+  c.j fail
+1:
+  c.jal 2f
+  c.j 3f
+2:
+  c.jr ra
+3:
+  la a5, 4f
+  c.jalr a5
+4:
+  la x29, 4b
+  bne ra, x29, fail
+
+test05:
+  c.li a1, 5
+  la ra, 6f
+  c.jalr ra
+5:
+  c.j fail
+6:
+  la x29, 5b
+  bne ra, x29, fail
+  li x29, 0
+
+success:
+  li a0, 10
+  ecall
+
+fail:
+  li a0, 1
+  ecall
+  li a0, 10
+  ecall
+
+  .balign 4
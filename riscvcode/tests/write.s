@@ -0,0 +1,53 @@
+######################
+#    write TESTS     #
+######################
+
+.globl __start
+
+.text
+
+__start:
+
+test01:
+  li x5, 0x4000
+  li x6, 0x6948
+  sh x6, 0(x5)
+  li x6, 10
+  sb x6, 2(x5)
+  li a1, 1
+  mv a2, x5
+  li a3, 3
+  li a0, 15
+  ecall
+  li x29, 3
+  bne a0, x29, fail
+
+test02:
+  li a1, 7
+  li a0, 1
+  ecall
+  li a1, 1
+  mv a2, x5
+  li a3, 0
+  li a0, 15
+  ecall
+  bne a0, x0, fail
+
+test03:
+  li a1, 3
+  mv a2, x5
+  li a3, 1
+  li a0, 15
+  ecall
+  li x29, -1
+  bne a0, x29, fail
+
+success:
+  li a0, 10
+  ecall
+
+fail:
+  li a0, 1
+  ecall
+  li a0, 10
+  ecall
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sample.h"
+#include "riscv.h"
+#include "predecode.h"
+#include "console.h"
+
+
+/* Sampled simulation. Only the intervals tools/rvsimpoint picked as
+   representative run in detail; the rest fast-forward functionally, and
+   each point's counts stand for its whole cluster. The points file:
+
+     interval <instructions>
+     intervals <count>
+     point <interval index> <weight>
+     ...
+
+   Point n starts once n * interval instructions have retired, just as
+   interval n of bbv.c does */
+
+/* Counts at the start and end of a point. Slot EVENT_NONE holds instret */
+typedef Double Snapshot[EVENT_COUNT];
+
+typedef struct {
+  Word index;
+  double weight;
+  Snapshot begin, end;
+  int started;
+} Point;
+
+static Point points[SAMPLE_MAX_POINTS];
+static int point_count;
+static Word interval, intervals;
+static Processor *sampled;
+
+static const char *event_names[EVENT_COUNT] = {
+  [EVENT_NONE] = "instructions",
+  [EVENT_LOAD] = "loads",
+  [EVENT_STORE] = "stores",
+  [EVENT_TAKEN_BRANCH] = "taken branches",
+  [EVENT_MULDIV] = "multiplies and divides",
+};
+
+
+static int by_index(const void *a, const void *b) {
+  Word x = ((const Point *) a)->index, y = ((const Point *) b)->index;
+  return x < y ? -1 : x > y;
+}
+
+
+static void read_points(const char *filename) {
+  FILE *file = fopen(filename, "r");
+  char line[128];
+  Point *point;
+
+  if (file == NULL) {
+    perror(filename);
+    exit(-1);
+  }
+  while (fgets(line, sizeof(line), file) != NULL) {
+    point = &points[point_count];
+    if (sscanf(line, "interval %u", &interval) == 1 || sscanf(line, "intervals %u", &intervals) == 1) continue;
+    if (sscanf(line, "point %u %lf", &point->index, &point->weight) == 2 && point_count < SAMPLE_MAX_POINTS) {
+      point_count++;
+    }
+  }
+  fclose(file);
+  if (interval == 0 || intervals == 0 || point_count == 0) {
+    fprintf(stderr, "%s: not a points file from tools/rvsimpoint\n", filename);
+    exit(-1);
+  }
+  qsort(points, point_count, sizeof(Point), by_index);
+}
+
+
+static void snapshot(Processor *processor, Snapshot counts) {
+  memcpy(counts, processor->counters.events, sizeof(Snapshot));
+  counts[EVENT_NONE] = processor->counters.instret;
+}
+
+
+/* Whole-program counts as the points predict them and as they came out.
+   A point the program ended in counts for what it ran */
+static void estimate(void) {
+  Snapshot measured;
+  double predicted;
+  int i, event, started = 0;
+
+  console_flush();
+  fflush(stdout);
+  snapshot(sampled, measured);
+  for (i = 0; i < point_count; i++) {
+    if (points[i].started && points[i].end[EVENT_NONE] == 0) memcpy(points[i].end, measured, sizeof(Snapshot));
+    started += points[i].started;
+  }
+  fprintf(stderr, "%d of %d simulation points run, standing for %u intervals of %u instructions\n",
+          started, point_count, intervals, interval);
+  for (event = 0; event < EVENT_COUNT; event++) {
+    predicted = 0;
+    for (i = 0; i < point_count; i++) {
+      if (points[i].started) predicted += points[i].weight * intervals * (points[i].end[event] - points[i].begin[event]);
+    }
+    fprintf(stderr, "%-24s %14.0f predicted %14llu measured\n",
+            event_names[event], predicted, (unsigned long long) measured[event]);
+  }
+}
+
+
+/* Runs on the fast engine until instret reaches target. A fused pair
+   retires two at once, so the last one or two go one at a time */
+static void fast_forward(Processor *processor, Byte *memory, Double target) {
+  while (processor->counters.instret + 2 <= target) predecode_execute(processor, memory);
+  while (processor->counters.instret < target) interpret(processor, memory);
+}
+
+
+void sample_run(Processor *processor, Byte *memory, const char *filename, int prompt, int print) {
+  Runner run = run_loop(prompt, print);
+  Double start, end;
+  Point *point;
+  int i;
+
+  read_points(filename);
+  sampled = processor;
+  predecode_init(1, NULL);
+  atexit(estimate);
+
+  for (i = 0; i < point_count; i++) {
+    point = &points[i];
+    start = (Double) point->index * interval;
+    end = start + interval;
+    fast_forward(processor, memory, start);
+
+    if (print || prompt) {
+      console_flush();
+      printf("simulation point %u, weight %f\n", point->index, point->weight);
+    }
+    snapshot(processor, point->begin);
+    point->started = 1;
+    while (processor->counters.instret < end) run(processor, end - processor->counters.instret);
+    snapshot(processor, point->end);
+  }
+  while (1) predecode_execute(processor, memory);
+}
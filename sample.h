@@ -0,0 +1,16 @@
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include "types.h"
+
+/* Most simulation points a file may list */
+#define SAMPLE_MAX_POINTS 256
+
+/* Runs the program with the simulation points in filename, as written by
+   tools/rvsimpoint, under execute() with prompt and print, and
+   everything between them on the predecoding engine. At exit, writes to
+   stderr the whole-program event counts the points' weights predict, next
+   to those measured. Does not return */
+void sample_run(Processor *, Byte *memory, const char *filename, int prompt, int print);
+
+#endif
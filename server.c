@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "server.h"
+#include "riscv.h"
+#include "hart.h"
+#include "console.h"
+#include "utils.h"
+
+
+/* A long-lived simulator for many small jobs. The workers are forked
+   once, after the listening socket and the guest memory are set up, and
+   each takes the next connection off the socket itself. A job clears
+   the worker's memory, loads its program there and runs it in the plain
+   run loop, so what a job costs is its instructions, not a process.
+
+   The ends of a program come back through halt_hook, as in fuzz.c. The
+   console goes to a file of the worker's own, cut back to nothing before
+   each job, and is sent from there. A worker that dies is replaced */
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+typedef struct {
+  char program[4096];
+  char *source;
+  Word source_length;
+  Word budget;
+  int digest;
+} Job;
+
+static Byte *arena;
+static FILE *log_file; // the server's stderr, as the jobs have the worker's
+
+static jmp_buf job_end;
+static int job_status;
+static Double digest;
+
+static volatile sig_atomic_t stopping;
+
+
+/* Reads a job off in. Returns 0, with the reason in error, if it is not
+   one */
+static int read_job(FILE *in, Job *job, char *error, size_t size) {
+  char line[4200], key[32], value[4096];
+
+  memset(job, 0, sizeof(Job));
+  job->budget = SERVER_DEFAULT_BUDGET;
+  while (fgets(line, sizeof(line), in) != NULL && line[0] != '\n') {
+    if (sscanf(line, "%31s %4095[^\n]", key, value) != 2) {
+      snprintf(error, size, "expected a key and a value");
+      return 0;
+    }
+    if (strcmp(key, "program") == 0) {
+      snprintf(job->program, sizeof(job->program), "%s", value);
+    } else if (strcmp(key, "source") == 0) {
+      job->source_length = strtoul(value, NULL, 0);
+      if (job->source_length > SERVER_MAX_SOURCE) {
+        snprintf(error, size, "source longer than %d bytes", SERVER_MAX_SOURCE);
+        return 0;
+      }
+      job->source = malloc(job->source_length + 1);
+    } else if (strcmp(key, "budget") == 0) {
+      job->budget = strtoul(value, NULL, 0);
+    } else if (strcmp(key, "digest") == 0) {
+      job->digest = atoi(value);
+    } else {
+      snprintf(error, size, "unknown key %s", key);
+      return 0;
+    }
+  }
+  if (job->source && fread(job->source, 1, job->source_length, in) != job->source_length) {
+    snprintf(error, size, "source shorter than its length");
+    return 0;
+  }
+  if (!job->source && !job->program[0]) {
+    snprintf(error, size, "no program or source");
+    return 0;
+  }
+  return 1;
+}
+
+
+/* Loads the job's program into cleared memory, as load_program() does */
+static int load_job(Job *job, char *error, size_t size) {
+  FILE *file;
+  char line[50];
+  Address at = 0x1000;
+  Word word;
+
+  if (job->source) file = job->source_length ? fmemopen(job->source, job->source_length, "r") : NULL;
+  else file = fopen(job->program, "r");
+  if (file == NULL && !(job->source && job->source_length == 0)) {
+    snprintf(error, size, "%s: %s", job->source ? "source" : job->program, strerror(errno));
+    return 0;
+  }
+
+  memset(arena, 0, MEMORY_SPACE);
+  while (file && fgets(line, sizeof(line), file) != NULL && at + 4 <= MEMORY_SPACE) {
+    word = (int32_t) strtol(line, NULL, 16);
+    memcpy(arena + at, &word, 4);
+    at += 4;
+  }
+  if (file) fclose(file);
+  return 1;
+}
+
+
+static void end_job(int status) {
+  job_status = status;
+  longjmp(job_end, 1);
+}
+
+
+/* Runs the job, leaving its console output in the worker's file.
+   Returns 0 if it ran out of budget */
+static int run_job(Job *job, Processor *processor) {
+  Runner run = run_loop(0, 0);
+  int r;
+
+  hart_reset(processor, 0);
+  digest = FNV_OFFSET;
+  if (setjmp(job_end)) return 1;
+
+  if (!job->digest) {
+    run(processor, job->budget);
+    return 0;
+  }
+  while (job->budget == 0 || processor->counters.instret < job->budget) {
+    run(processor, 1);
+    for (r = 0; r < 32; r++) {
+      digest = (digest ^ (processor->R[r] & 0xff)) * FNV_PRIME;
+      digest = (digest ^ (processor->R[r] >> 8 & 0xff)) * FNV_PRIME;
+      digest = (digest ^ (processor->R[r] >> 16 & 0xff)) * FNV_PRIME;
+      digest = (digest ^ (processor->R[r] >> 24)) * FNV_PRIME;
+    }
+  }
+  return 0;
+}
+
+
+/* Sends the reply, the output from the worker's file */
+static void reply(FILE *out, Job *job, Processor *processor, int ended) {
+  char chunk[65536];
+  off_t length, sent;
+  ssize_t got;
+
+  console_flush();
+  fflush(stdout);
+  fflush(stderr);
+  length = lseek(STDOUT_FILENO, 0, SEEK_END);
+
+  if (ended) fprintf(out, "status %d\n", job_status);
+  else fprintf(out, "status budget\n");
+  fprintf(out, "instructions %llu\n", (unsigned long long) processor->counters.instret);
+  if (job->digest) fprintf(out, "digest %016llx\n", (unsigned long long) digest);
+  fprintf(out, "output %lld\n", (long long) length);
+  for (sent = 0; sent < length; sent += got) {
+    if ((got = pread(STDOUT_FILENO, chunk, sizeof(chunk), sent)) <= 0) break;
+    fwrite(chunk, 1, got, out);
+  }
+}
+
+
+static void work(int server) {
+  char error[4400];
+  Processor processor;
+  FILE *in, *out, *output = tmpfile();
+  int client, ended, null = open("/dev/null", O_RDONLY);
+  Job job;
+
+  if (output == NULL || null < 0) {
+    perror("server");
+    exit(-1);
+  }
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  signal(SIGPIPE, SIG_IGN);
+  log_file = fdopen(dup(STDERR_FILENO), "w");
+  dup2(null, STDIN_FILENO);
+  dup2(fileno(output), STDOUT_FILENO);
+  dup2(fileno(output), STDERR_FILENO);
+  halt_hook = end_job;
+
+  while (1) {
+    if ((client = accept(server, NULL, NULL)) < 0) {
+      if (errno != EINTR) fprintf(log_file, "server: accept: %s\n", strerror(errno));
+      continue;
+    }
+    in = fdopen(client, "r");
+    out = fdopen(dup(client), "w");
+    if (in == NULL || out == NULL) {
+      fprintf(log_file, "server: fdopen: %s\n", strerror(errno));
+      if (out) fclose(out);
+      if (in) fclose(in);
+      else close(client);
+      continue;
+    }
+    if (read_job(in, &job, error, sizeof(error)) && load_job(&job, error, sizeof(error))) {
+      ftruncate(STDOUT_FILENO, 0);
+      lseek(STDOUT_FILENO, 0, SEEK_SET);
+      ended = run_job(&job, &processor);
+      reply(out, &job, &processor, ended);
+    } else {
+      fprintf(out, "error %s\n", error);
+    }
+    fclose(out);
+    fclose(in);
+    free(job.source);
+  }
+}
+
+
+static pid_t start_worker(int server) {
+  pid_t pid = fork();
+  if (pid == 0) work(server);
+  if (pid < 0) perror("server: fork");
+  return pid;
+}
+
+
+static void stop(int number) {
+  stopping = 1;
+}
+
+
+void server_run(Byte *memory, const char *path, int count) {
+  struct sigaction action;
+  pid_t *workers, pid;
+  int server, i, status;
+
+  if ((server = listen_unix(path, SOMAXCONN)) < 0) {
+    fprintf(stderr, "cannot listen on %s: %s\n", path, strerror(errno));
+    exit(-1);
+  }
+  arena = memory;
+  fflush(stdout);
+
+  // no SA_RESTART, so that wait() returns to look at stopping
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = stop;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  workers = calloc(count, sizeof(pid_t));
+  fprintf(stderr, "serving on %s with %d workers\n", path, count);
+
+  while (!stopping) {
+    for (i = 0; i < count; i++) {
+      if (workers[i] <= 0) workers[i] = start_worker(server);
+    }
+    if ((pid = wait(&status)) < 0) {
+      // none left to wait for, as forking failed: try again in a while
+      if (errno == ECHILD) sleep(1);
+      continue;
+    }
+    for (i = 0; i < count; i++) {
+      if (workers[i] != pid) continue;
+      fprintf(stderr, "worker %d ended with status %d, replacing it\n", (int) pid, status);
+      workers[i] = 0;
+    }
+  }
+  for (i = 0; i < count; i++) {
+    if (workers[i] > 0) kill(workers[i], SIGTERM);
+  }
+  while (wait(&status) > 0);
+  unlink(path);
+  exit(0);
+}
@@ -0,0 +1,35 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "types.h"
+
+/* Instructions a job may run unless it asks for another budget */
+#define SERVER_DEFAULT_BUDGET 1000000000
+
+/* Largest program a job can send as source, in bytes of .input text */
+#define SERVER_MAX_SOURCE (4 * 1024 * 1024)
+
+/* Serves simulation jobs on the Unix socket at path, one per connection,
+   with workers processes taking them in turn. Does not return.
+
+   A job is "key value" lines up to an empty line:
+
+     program path    the .input file to run, or
+     source length   the .input text itself, length bytes after the
+                     empty line
+     budget n        instructions to run at most, 0 for no limit
+     digest 1        also hash the registers after every instruction
+
+   and the reply is
+
+     status s        the exit status, or "budget" if it ran out
+     instructions n
+     digest h        FNV-1a of x0-x31 as 32-bit little-endian words after
+                     each instruction, in 16 hex digits, if asked for
+     output length   then the length bytes the program wrote to the
+                     console, with what riscv says about it
+
+   or "error message" for a job that could not be run */
+void server_run(Byte *memory, const char *path, int workers);
+
+#endif
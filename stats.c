@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "stats.h"
+#include "console.h"
+#include "predecode.h"
+
+
+/* The simulator watching itself: a thread that wakes every
+   STATS_SAMPLE_US to note which phase the simulator is in, and every
+   period to read the harts' instret, from which come the MIPS. Counters
+   the simulator keeps anyway are read as they are, without a lock, so a
+   snapshot may be a few instructions out */
+
+volatile int stats_phase = STATS_OTHER;
+int stats_running;
+Double stats_trace_bytes;
+
+static const char *phase_names[STATS_PHASES] = { "other", "fetch", "decode", "execute", "trace" };
+
+static Processor *harts;
+static int hart_count, summary_wanted, decode_cache;
+static const char *snapshot_path;
+static Word period_ms;
+
+/* Guards what the monitor thread and the exit handler both write */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static Double samples[STATS_PHASES], sample_total;
+static double start, last_time, mips, mips_peak, mips_low;
+static Double last_instret;
+static int readings, finished;
+
+
+static double now(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+
+static Double instret(void) {
+  Double total = 0;
+  int i;
+  for (i = 0; i < hart_count; i++) total += __atomic_load_n(&harts[i].counters.instret, __ATOMIC_RELAXED);
+  return total;
+}
+
+
+/* Instructions per microsecond since the last reading */
+static void read_mips(double time) {
+  Double retired = instret();
+  mips = (retired - last_instret) / (time - last_time) / 1e6;
+  if (readings == 0 || mips > mips_peak) mips_peak = mips;
+  if (readings == 0 || mips < mips_low) mips_low = mips;
+  readings++;
+  last_instret = retired;
+  last_time = time;
+}
+
+
+/* Of the instructions retired, those whose decoding was kept. Short runs
+   can miss on about every one */
+static double hit_rate(Double retired) {
+  return retired > predecode_misses ? 1 - (double) predecode_misses / retired : 0;
+}
+
+
+static void write_snapshot(double time) {
+  char temporary[4096 + 16];
+  Double retired = instret();
+  FILE *file;
+  int i;
+
+  snprintf(temporary, sizeof(temporary), "%s.tmp", snapshot_path);
+  if ((file = fopen(temporary, "w")) == NULL) {
+    perror(temporary);
+    snapshot_path = NULL;
+    return;
+  }
+  fprintf(file, "{\n  \"elapsed\": %.3f,\n  \"finished\": %s,\n", time - start, finished ? "true" : "false");
+  fprintf(file, "  \"instret\": %llu,\n  \"harts\": [", (unsigned long long) retired);
+  for (i = 0; i < hart_count; i++) {
+    fprintf(file, "%s%llu", i ? ", " : "", (unsigned long long) harts[i].counters.instret);
+  }
+  fprintf(file, "],\n  \"mips\": %.3f,\n  \"mips_average\": %.3f,\n  \"mips_peak\": %.3f,\n",
+          mips, time > start ? retired / (time - start) / 1e6 : 0, mips_peak);
+  fprintf(file, "  \"phases\": {");
+  for (i = 0; i < STATS_PHASES; i++) {
+    fprintf(file, "%s\"%s\": %.4f", i ? ", " : "", phase_names[i], sample_total ? (double) samples[i] / sample_total : 0);
+  }
+  fprintf(file, "},\n  \"output_bytes\": %llu,\n  \"trace_bytes\": %llu",
+          (unsigned long long) console_bytes(), (unsigned long long) stats_trace_bytes);
+  if (decode_cache) {
+    fprintf(file, ",\n  \"decode_cache\": {\"misses\": %llu, \"invalidations\": %llu, \"hit_rate\": %.6f}",
+            (unsigned long long) predecode_misses, (unsigned long long) predecode_invalidations,
+            hit_rate(retired));
+  }
+  fprintf(file, "\n}\n");
+  fclose(file);
+  if (rename(temporary, snapshot_path) != 0) perror(snapshot_path);
+}
+
+
+static void *monitor(void *unused) {
+  struct timespec tick = { 0, STATS_SAMPLE_US * 1000 };
+  double time, next = start + period_ms / 1e3;
+
+  while (1) {
+    nanosleep(&tick, NULL);
+    pthread_mutex_lock(&lock);
+    if (finished) {
+      pthread_mutex_unlock(&lock);
+      return NULL;
+    }
+    samples[stats_phase]++;
+    sample_total++;
+    if ((time = now()) >= next) {
+      read_mips(time);
+      if (snapshot_path) write_snapshot(time);
+      next = time + period_ms / 1e3;
+    }
+    pthread_mutex_unlock(&lock);
+  }
+}
+
+
+static double share(int phase) {
+  return sample_total ? 100.0 * samples[phase] / sample_total : 0;
+}
+
+
+static void print_summary(void) {
+  double elapsed = now() - start;
+  Double retired = instret();
+
+  console_flush();
+  fflush(stdout);
+  fprintf(stderr, "stats: %llu instructions in %.3fs, %.2f MIPS",
+          (unsigned long long) retired, elapsed, elapsed > 0 ? retired / elapsed / 1e6 : 0);
+  if (readings) fprintf(stderr, " (%.2f to %.2f over %d readings)", mips_low, mips_peak, readings);
+  fprintf(stderr, "\nstats: time in fetch %.1f%%, decode %.1f%%, execute %.1f%%, trace %.1f%%, other %.1f%%\n",
+          share(STATS_FETCH), share(STATS_DECODE), share(STATS_EXECUTE), share(STATS_TRACE), share(STATS_OTHER));
+  fprintf(stderr, "stats: %llu bytes of guest output, %llu of trace\n",
+          (unsigned long long) console_bytes(), (unsigned long long) stats_trace_bytes);
+  if (decode_cache) {
+    fprintf(stderr, "stats: decode cache %.4f%% hits, %llu misses, %llu invalidations\n",
+            100 * hit_rate(retired),
+            (unsigned long long) predecode_misses, (unsigned long long) predecode_invalidations);
+  }
+}
+
+
+static void finish(void) {
+  pthread_mutex_lock(&lock);
+  finished = 1;
+  if (snapshot_path) write_snapshot(now());
+  if (summary_wanted) print_summary();
+  pthread_mutex_unlock(&lock);
+}
+
+
+void stats_init(Processor *processors, int count, int summary, const char *snapshot, Word period, int decode) {
+  pthread_t thread;
+
+  harts = processors;
+  hart_count = count;
+  summary_wanted = summary;
+  snapshot_path = snapshot;
+  period_ms = period;
+  decode_cache = decode;
+  start = last_time = now();
+  stats_running = 1;
+
+  atexit(finish);
+  pthread_create(&thread, NULL, monitor, NULL);
+  pthread_detach(thread);
+}
@@ -0,0 +1,41 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "types.h"
+
+/* How often the monitor thread looks at what the simulator is doing */
+#define STATS_SAMPLE_US 1000
+
+/* Milliseconds between snapshots, and between MIPS readings, unless
+   --stats-period says otherwise */
+#define STATS_DEFAULT_PERIOD 1000
+
+/* What the simulator is busy with. Set as it goes, with a plain store,
+   and sampled by the monitor thread, so the shares of time are
+   estimates from STATS_SAMPLE_US ticks rather than clock readings */
+typedef enum {
+  STATS_OTHER,   // loading, waiting at the prompt, the simulator's own work
+  STATS_FETCH,
+  STATS_DECODE,
+  STATS_EXECUTE, // also whatever engine runs instructions without execute()
+  STATS_TRACE,   // printing the register dump or disassembly
+  STATS_PHASES
+} StatsPhase;
+
+extern volatile int stats_phase;
+
+/* Whether stats_init() ran, and so whether run loops set stats_phase */
+extern int stats_running;
+
+/* Bytes of -r and -t output */
+extern Double stats_trace_bytes;
+
+/* Starts the monitor thread on count harts. With summary, prints what it
+   saw to stderr at exit. With snapshot, writes it there as JSON every
+   period milliseconds, replacing the file whole so that a reader polling
+   it never sees half of one; a path in /dev/shm keeps it in memory.
+   decode_cache says whether the predecoding engine runs, whose misses
+   are counted as well */
+void stats_init(Processor *harts, int count, int summary, const char *snapshot, Word period, int decode_cache);
+
+#endif
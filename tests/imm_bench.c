@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../types.h"
+#include "../utils.h"
+
+
+/* Compares the imm_* decoders in utils.h with the get_* reference
+   functions they replace in the execute path. Run with make imm_bench */
+
+#define WORDS (1 << 16)
+#define ROUNDS 2000
+
+static Word words[WORDS];
+static volatile sWord sink;
+
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+#define BENCH(label, expr) do { \
+    double start = now(); \
+    sWord sum = 0; \
+    int round, i; \
+    for (round = 0; round < ROUNDS; round++) { \
+      for (i = 0; i < WORDS; i++) { \
+        Instruction instruction = { .bits = words[i] }; \
+        sum += (expr); \
+      } \
+    } \
+    sink = sum; \
+    printf("%-24s %6.2f ns/op\n", label, (now() - start) * 1e9 / ((double) ROUNDS * WORDS)); \
+  } while (0)
+
+
+int main(void) {
+  int i;
+  srand(1);
+  for (i = 0; i < WORDS; i++) words[i] = (Word) rand() << 16 ^ (Word) rand();
+
+  BENCH("bitExtender(imm, 12)", bitExtender(instruction.itype.imm, 12));
+  BENCH("imm_i", imm_i(instruction.bits));
+  BENCH("get_memory_offset", get_memory_offset(instruction));
+  BENCH("imm_s", imm_s(instruction.bits));
+  BENCH("get_branch_distance", get_branch_distance(instruction));
+  BENCH("imm_b", imm_b(instruction.bits));
+  BENCH("get_jump_distance", get_jump_distance(instruction));
+  BENCH("imm_j", imm_j(instruction.bits));
+  return 0;
+}
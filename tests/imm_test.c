@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include "../types.h"
+#include "../utils.h"
+
+
+/* Checks the branchless imm_* decoders in utils.h against the reference
+   get_* functions in utils.c for every encodable immediate. Each encoding
+   is tried with the other instruction bits all clear and all set, so a
+   decoder that leaks a neighbouring field is caught too */
+
+static int failures;
+
+static void expect(const char *what, Word bits, sWord got, sWord want) {
+  if (got != want && failures++ < 10) {
+    printf("%s(0x%08x) = %d, expected %d\n", what, bits, got, want);
+  }
+}
+
+
+/* Spreads the low bits of value over the bits set in mask */
+static Word deposit(Word value, Word mask) {
+  Word bits = 0, bit;
+  for (bit = 1; mask; bit <<= 1) {
+    if (mask & bit) {
+      if (value & 1) bits |= bit;
+      value >>= 1;
+      mask &= ~bit;
+    }
+  }
+  return bits;
+}
+
+
+static void check_format(const char *what, Word field_mask, int field_bits,
+                         sWord (*fast)(Word), int (*reference)(Instruction)) {
+  Word value, others;
+  Instruction instruction;
+  for (value = 0; value < (1u << field_bits); value++) {
+    for (others = 0; others <= 1; others++) {
+      instruction.bits = deposit(value, field_mask) | (others ? ~field_mask : 0);
+      expect(what, instruction.bits, fast(instruction.bits), reference(instruction));
+    }
+  }
+}
+
+
+static int reference_i(Instruction instruction) {
+  return bitExtender(instruction.itype.imm, 12);
+}
+
+static int reference_u(Instruction instruction) {
+  return instruction.utype.imm << 12;
+}
+
+
+int main(void) {
+  check_format("imm_i", 0xFFF00000, 12, imm_i, reference_i);
+  check_format("imm_s", 0xFE000F80, 12, imm_s, get_memory_offset);
+  check_format("imm_b", 0xFE000F80, 12, imm_b, get_branch_distance);
+  check_format("imm_u", 0xFFFFF000, 20, imm_u, reference_u);
+  check_format("imm_j", 0xFFFFF000, 20, imm_j, get_jump_distance);
+
+  if (failures) {
+    printf("imm_test: %d mismatches\n", failures);
+    return 1;
+  }
+  printf("imm_test: all immediate encodings match\n");
+  return 0;
+}
@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+
+/* Sends one job to riscv --serve and prints the reply:
+
+     job_client socket < job
+
+   The job is stdin as it is, see server.h. The socket is tried for a few
+   seconds, since the server may still be starting */
+
+#define CONNECT_TRIES 50
+
+static int server;
+
+
+static int connect_to(const char *path) {
+  struct sockaddr_un address = { .sun_family = AF_UNIX };
+  int tries;
+
+  snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+  for (tries = 0; tries < CONNECT_TRIES; tries++) {
+    server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connect(server, (struct sockaddr *) &address, sizeof(address)) == 0) return 1;
+    close(server);
+    usleep(100000);
+  }
+  return 0;
+}
+
+
+int main(int argc, char **argv) {
+  char buffer[65536];
+  ssize_t got;
+
+  if (argc != 2) {
+    fprintf(stderr, "usage: job_client socket < job\n");
+    return -1;
+  }
+  if (!connect_to(argv[1])) {
+    perror(argv[1]);
+    return -1;
+  }
+  while ((got = read(STDIN_FILENO, buffer, sizeof(buffer))) > 0) {
+    if (send(server, buffer, got, MSG_NOSIGNAL) != got) {
+      perror("send");
+      return -1;
+    }
+  }
+  shutdown(server, SHUT_WR);
+  while ((got = recv(server, buffer, sizeof(buffer), 0)) > 0) fwrite(buffer, 1, got, stdout);
+  close(server);
+  return 0;
+}
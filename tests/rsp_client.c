@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+
+/* Plays a gdb remote serial protocol session against riscv -g:
+
+     rsp_client socket < script
+
+   Each line of the script is a packet body. It is sent framed and
+   checksummed, the stub's ack and reply are read, and the two are printed
+   as "packet -> reply" for comparing with a transcript. The socket is
+   tried for a few seconds, since the stub may still be starting */
+
+#define PACKET_SIZE 4096
+#define CONNECT_TRIES 50
+
+static int server;
+
+
+static int connect_to(const char *path) {
+  struct sockaddr_un address = { .sun_family = AF_UNIX };
+  int tries;
+
+  snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+  for (tries = 0; tries < CONNECT_TRIES; tries++) {
+    server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connect(server, (struct sockaddr *) &address, sizeof(address)) == 0) return 1;
+    close(server);
+    usleep(100000);
+  }
+  return 0;
+}
+
+
+static int get_char(void) {
+  unsigned char c;
+  return recv(server, &c, 1, 0) == 1 ? c : -1;
+}
+
+
+/* Reads the next packet into reply and acks it. Returns 0 if the stub
+   has gone */
+static int receive_packet(char *reply) {
+  int c, length = 0;
+
+  while ((c = get_char()) != '$') {
+    if (c < 0) return 0;
+  }
+  while ((c = get_char()) != '#') {
+    if (c < 0) return 0;
+    if (length < PACKET_SIZE - 1) reply[length++] = c;
+  }
+  reply[length] = '\0';
+  if (get_char() < 0 || get_char() < 0) return 0;
+  send(server, "+", 1, MSG_NOSIGNAL);
+  return 1;
+}
+
+
+int main(int argc, char **argv) {
+  char line[PACKET_SIZE], framed[PACKET_SIZE + 4], reply[PACKET_SIZE];
+  unsigned char sum;
+  size_t length, i;
+
+  if (argc != 2) {
+    fprintf(stderr, "usage: rsp_client socket < script\n");
+    return -1;
+  }
+  if (!connect_to(argv[1])) {
+    perror(argv[1]);
+    return -1;
+  }
+  while (fgets(line, sizeof(line) - 4, stdin) != NULL) {
+    length = strcspn(line, "\n");
+    line[length] = '\0';
+    for (sum = 0, i = 0; i < length; i++) sum += line[i];
+    snprintf(framed, sizeof(framed), "$%s#%02x", line, sum);
+    send(server, framed, strlen(framed), MSG_NOSIGNAL);
+    if (get_char() != '+' || !receive_packet(reply)) {
+      printf("%s -> (gone)\n", line);
+      return 1;
+    }
+    printf("%s -> %s\n", line, reply);
+  }
+  close(server);
+  return 0;
+}
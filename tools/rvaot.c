@@ -0,0 +1,310 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../types.h"
+#include "../utils.h"
+#include "../isa.h"
+
+
+/* Translates a program, in the format load_program() reads, to C with one
+   function per basic block, for the simulator's -A (see aot.h):
+
+     rvaot [-o file.c] file.input
+     gcc -O2 -shared -fPIC -I. -o file.so file.c
+     ./riscv -A file.so file.input
+
+   The simpler instructions become C expressions on the registers. The
+   rest, and anything that can end the program, go through
+   execute_decoded() with the Decoded record built in. Blocks end at
+   branches, jumps and ecalls, and wherever another block starts. A
+   block leaving for a target known here returns that block, a jalr
+   leaves the lookup to the runtime. Compressed instructions run as what
+   they expand to, so blocks and their lookup go by halfword */
+
+#define BASE 0x1000
+
+static Word *image;
+static Word words;
+static Decoded *decoded; // one per halfword of the image
+static Byte *leaders;
+static FILE *out;
+
+/* Instructions run since instret was last brought up to date */
+static Word pending;
+
+
+static void read_image(const char *filename) {
+  FILE *file = fopen(filename, "r");
+  char line[50];
+  Word capacity = 0, slot;
+  Instruction instruction;
+
+  if (file == NULL) {
+    perror(filename);
+    exit(-1);
+  }
+  // split into lines exactly as load_program() does
+  while (fgets(line, sizeof(line), file) != NULL) {
+    if (words == capacity) {
+      capacity = capacity ? 2 * capacity : 4096;
+      image = realloc(image, capacity * sizeof(Word));
+    }
+    image[words++] = (int32_t) strtol(line, NULL, 16);
+  }
+  fclose(file);
+
+  // whatever is at each halfword, in case a jump goes there
+  decoded = malloc(2 * words * sizeof(Decoded));
+  for (slot = 0; slot < 2 * words; slot++) {
+    instruction.bits = 0;
+    memcpy(&instruction.bits, (Byte *) image + 2 * slot, slot + 1 < 2 * words ? 4 : 2);
+    decode(instruction, &decoded[slot]);
+  }
+}
+
+
+static int in_image(Address pc) {
+  return (pc & 1) == 0 && (pc - BASE) >> 1 < 2 * words;
+}
+
+
+static void mark_leader(Address pc) {
+  if (in_image(pc)) leaders[(pc - BASE) >> 1] = 1;
+}
+
+
+/* The same blocks as predecode.c finds */
+static void find_leaders(void) {
+  Word i;
+  Address pc;
+
+  leaders = calloc(2 * words + 1, 1);
+  mark_leader(BASE);
+  for (i = 0; i < 2 * words; i += decoded[i].length / 2) {
+    pc = BASE + 2 * i;
+    switch (decoded[i].op) {
+      case OP_beq:
+      case OP_bne:
+      case OP_jal:
+        mark_leader(pc + decoded[i].imm);
+        // fall through
+      case OP_jalr:
+      case OP_ecall:
+        mark_leader(pc + decoded[i].length);
+        break;
+    }
+  }
+}
+
+
+static void flush_instret(void) {
+  if (pending) fprintf(out, "  p->counters.instret += %u;\n", pending);
+  pending = 0;
+}
+
+
+/* Where to go after setting the PC to target */
+static void leave(const char *indent, Address target) {
+  fprintf(out, "%s  p->PC = 0x%08x;\n", indent, target);
+  if (in_image(target) && leaders[(target - BASE) >> 1]) {
+    fprintf(out, "%s  return (AotNext) { block_%08x };\n", indent, target);
+  } else {
+    fprintf(out, "%s  return (AotNext) { NULL };\n", indent);
+  }
+}
+
+
+/* The instruction as the interpreter runs it */
+static void fallback(const Decoded *d, Address pc) {
+  flush_instret();
+  fprintf(out, "  {\n    static const Decoded d = { .bits = 0x%08x, .op = %d, .rd = %d, .rs1 = %d, .rs2 = %d, "
+          ".length = %d, .compressed = %d, .imm = %d };\n", d->bits, d->op, d->rd, d->rs1, d->rs2, d->length, d->compressed, d->imm);
+  fprintf(out, "    p->PC = 0x%08x;\n    execute_decoded(&d, p, memory);\n    R[0] = 0;\n  }\n", pc);
+}
+
+
+static const char *operator(Op op) {
+  switch (op) {
+    case OP_addi: case OP_add: return "+";
+    case OP_sub: return "-";
+    case OP_xori: case OP_xor: return "^";
+    case OP_ori: case OP_or: return "|";
+    case OP_andi: case OP_and: return "&";
+    case OP_slli: case OP_sll: return "<<";
+    default: return ">>";
+  }
+}
+
+
+/* Writes the instruction at pc. Returns whether it ends the block */
+static int translate(const Decoded *d, Address pc) {
+  static const char *lengths[] = { "", "LENGTH_BYTE", "LENGTH_HALF_WORD", "", "LENGTH_WORD" };
+  static const int bits[] = { 0, 8, 16, 0, 32 };
+  Address next = pc + d->length;
+  int size;
+
+  fprintf(out, "  // %08x: %s\n", pc, instruction_specs[d->op].name);
+  pending++;
+
+  switch (d->op) {
+    case OP_lui:
+    case OP_auipc:
+      if (d->rd) fprintf(out, "  R[%d] = 0x%08x;\n", d->rd, d->op == OP_lui ? d->imm : pc + d->imm);
+      return 0;
+    case OP_addi:
+    case OP_xori:
+    case OP_ori:
+    case OP_andi:
+      if (d->rd) fprintf(out, "  R[%d] = R[%d] %s (Word) %d;\n", d->rd, d->rs1, operator(d->op), d->imm);
+      return 0;
+    case OP_slti:
+      if (d->rd) fprintf(out, "  R[%d] = (sWord) R[%d] < %d;\n", d->rd, d->rs1, d->imm);
+      return 0;
+    case OP_slli:
+    case OP_srli:
+      if (d->rd) fprintf(out, "  R[%d] = R[%d] %s %d;\n", d->rd, d->rs1, operator(d->op), d->imm);
+      return 0;
+    case OP_srai:
+      if (d->rd) fprintf(out, "  R[%d] = (sWord) R[%d] >> %d;\n", d->rd, d->rs1, d->imm);
+      return 0;
+    case OP_add:
+    case OP_sub:
+    case OP_xor:
+    case OP_or:
+    case OP_and:
+      if (d->rd) fprintf(out, "  R[%d] = R[%d] %s R[%d];\n", d->rd, d->rs1, operator(d->op), d->rs2);
+      return 0;
+    case OP_sll:
+    case OP_srl:
+      if (d->rd) fprintf(out, "  R[%d] = R[%d] %s (R[%d] & 31);\n", d->rd, d->rs1, operator(d->op), d->rs2);
+      return 0;
+    case OP_sra:
+      if (d->rd) fprintf(out, "  R[%d] = (sWord) R[%d] >> (R[%d] & 31);\n", d->rd, d->rs1, d->rs2);
+      return 0;
+    case OP_slt:
+      if (d->rd) fprintf(out, "  R[%d] = (sWord) R[%d] < (sWord) R[%d];\n", d->rd, d->rs1, d->rs2);
+      return 0;
+    case OP_mul:
+      fprintf(out, "  p->counters.events[EVENT_MULDIV]++;\n");
+      if (d->rd) fprintf(out, "  R[%d] = R[%d] * R[%d];\n", d->rd, d->rs1, d->rs2);
+      return 0;
+    case OP_lb:
+    case OP_lh:
+    case OP_lw:
+      size = 1 << (d->op - OP_lb);
+      fprintf(out, "  p->counters.events[EVENT_LOAD]++;\n");
+      // a load into x0 can still fault
+      if (d->rd) fprintf(out, "  R[%d] = ", d->rd);
+      else fprintf(out, "  (void) ");
+      if (size == 4) fprintf(out, "load(memory, R[%d] + (Word) %d, LENGTH_WORD, 0);\n", d->rs1, d->imm);
+      else fprintf(out, "sign_extend(load(memory, R[%d] + (Word) %d, %s, 0), %d);\n", d->rs1, d->imm, lengths[size], bits[size]);
+      return 0;
+    case OP_sb:
+    case OP_sh:
+    case OP_sw:
+      size = 1 << (d->op - OP_sb);
+      fprintf(out, "  p->counters.events[EVENT_STORE]++;\n");
+      fprintf(out, "  store(memory, R[%d] + (Word) %d, %s, R[%d], 0);\n", d->rs1, d->imm, lengths[size], d->rs2);
+      return 0;
+    case OP_beq:
+    case OP_bne:
+      flush_instret();
+      fprintf(out, "  if ((sWord) R[%d] %s (sWord) R[%d]) {\n", d->rs1, d->op == OP_beq ? "==" : "!=", d->rs2);
+      fprintf(out, "    p->counters.events[EVENT_TAKEN_BRANCH]++;\n");
+      leave("  ", pc + d->imm);
+      fprintf(out, "  }\n");
+      leave("", next);
+      return 1;
+    case OP_jal:
+      flush_instret();
+      if (d->rd) fprintf(out, "  R[%d] = 0x%08x;\n", d->rd, next);
+      leave("", pc + d->imm);
+      return 1;
+    case OP_jalr:
+      flush_instret();
+      // the target is taken before rd is written, as in part2.c
+      fprintf(out, "  p->PC = (R[%d] + (Word) %d) & ~1u;\n", d->rs1, d->imm);
+      if (d->rd) fprintf(out, "  R[%d] = 0x%08x;\n", d->rd, next);
+      fprintf(out, "  return (AotNext) { NULL };\n");
+      return 1;
+    default:
+      pending--;
+      fallback(d, pc);
+      if (d->op != OP_ecall) return 0;
+      leave("", next);
+      return 1;
+  }
+}
+
+
+static void translate_block(Word first) {
+  Word i, next;
+  Address pc;
+
+  fprintf(out, "\nstatic AotNext block_%08x(Processor *p, Byte *memory) {\n", BASE + 2 * first);
+  pending = 0;
+  for (i = first; i < 2 * words; i = next) {
+    pc = BASE + 2 * i;
+    next = i + decoded[i].length / 2;
+    if (translate(&decoded[i], pc)) break;
+    if (next >= 2 * words || leaders[next]) {
+      flush_instret();
+      leave("", BASE + 2 * next);
+      break;
+    }
+  }
+  fprintf(out, "}\n");
+}
+
+
+int main(int argc, char **argv) {
+  Word i;
+  int c;
+
+  out = stdout;
+  while ((c = getopt(argc, argv, "o:")) != -1) {
+    switch (c) {
+      case 'o':
+        if ((out = fopen(optarg, "w")) == NULL) {
+          perror(optarg);
+          return -1;
+        }
+        break;
+      default:
+        fprintf(stderr, "usage: rvaot [-o file.c] file.input\n");
+        return -1;
+    }
+  }
+  if (argc <= optind) {
+    fprintf(stderr, "usage: rvaot [-o file.c] file.input\n");
+    return -1;
+  }
+
+  read_image(argv[optind]);
+  if (words == 0) {
+    fprintf(stderr, "rvaot: %s is empty\n", argv[optind]);
+    return -1;
+  }
+  find_leaders();
+
+  fprintf(out, "/* Translated from %s by tools/rvaot */\n#include \"aot.h\"\n\n#define R (p->R)\n\n", argv[optind]);
+  for (i = 0; i < 2 * words; i++) {
+    if (leaders[i]) fprintf(out, "static AotNext block_%08x(Processor *, Byte *);\n", BASE + 2 * i);
+  }
+  for (i = 0; i < 2 * words; i++) {
+    if (leaders[i]) translate_block(i);
+  }
+
+  fprintf(out, "\nconst Address aot_base = 0x%08x;\nconst Word aot_words = %u;\nconst Word aot_op_count = %d;\n", BASE, words, OP_COUNT);
+  fprintf(out, "\nconst AotBlock aot_blocks[%u] = {\n", 2 * words);
+  for (i = 0; i < 2 * words; i++) {
+    if (leaders[i]) fprintf(out, "  [%u] = block_%08x,\n", i, BASE + 2 * i);
+  }
+  fprintf(out, "};\n\nconst Word aot_image[%u] = {", words);
+  for (i = 0; i < words; i++) fprintf(out, "%s0x%08x,", i % 8 ? " " : "\n  ", image[i]);
+  fprintf(out, "\n};\n");
+
+  if (out != stdout) fclose(out);
+  return 0;
+}
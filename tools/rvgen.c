@@ -0,0 +1,574 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../types.h"
+#include "../utils.h"
+#include "../isa.h"
+
+
+/* Writes a random program as a .input file for load_program(). Every
+   instruction in isa.h can appear, compressed ones included, picked by
+   class with configurable weights. Programs always terminate: branches
+   and jumps only go forward, except at the end of loops with a fixed
+   trip count, and the last instruction is ecall 10.
+
+   Compressed instructions come two to a word, so that everything else
+   stays word aligned; a compressed branch or jump takes the first half
+   and a c.nop the second.
+
+     rvgen [-n words] [-s seed] [-l max trips] [-m class=weight,...] [-o file]
+
+   Registers x24-x27 are kept for the generator's own use, everything
+   else is fair game */
+
+#define CODE_BASE 0x1000
+
+/* Loads, stores and atomics stay within 2 KiB either side of this, well
+   away from code and from the stack at 0xEFFFF */
+#define DATA_BASE 0xF8000
+
+/* Longest run of instructions a forward branch or jump skips, and the
+   longest loop body */
+#define MAX_SKIP 8
+#define MAX_BODY 16
+
+#define REG_JUMP 24  // jalr target
+#define REG_ATOMIC 25  // address for LR/SC and the AMOs
+#define REG_LOOP 26  // trip counter
+#define REG_DATA 27  // DATA_BASE
+#define REG_FREE 24  // x1-x23 are free
+
+/* Instruction classes, each with its own weight */
+#define CLASSES(X) \
+  X(alu, 40) \
+  X(mul, 8) \
+  X(load, 12) \
+  X(store, 10) \
+  X(branch, 8) \
+  X(jump, 4) \
+  X(loop, 2) \
+  X(csr, 2) \
+  X(atomic, 4) \
+  X(compressed, 6) \
+  X(ecall, 0)
+
+#define CLASS_ENUM(name, weight) CLASS_##name,
+typedef enum {
+  CLASSES(CLASS_ENUM)
+  CLASS_COUNT
+} Class;
+#undef CLASS_ENUM
+
+#define CLASS_NAME(name, weight) #name,
+static const char *class_names[CLASS_COUNT] = { CLASSES(CLASS_NAME) };
+#undef CLASS_NAME
+
+#define CLASS_WEIGHT(name, weight) weight,
+static int weights[CLASS_COUNT] = { CLASSES(CLASS_WEIGHT) };
+#undef CLASS_WEIGHT
+
+static Word *code;
+static Word length, capacity;
+static Double random_state;
+static Word max_trips = 16;
+
+
+static Word random_below(Word n) {
+  // xorshift64*
+  random_state ^= random_state >> 12;
+  random_state ^= random_state << 25;
+  random_state ^= random_state >> 27;
+  return (random_state * 0x2545F4914F6CDD1DULL >> 32) % n;
+}
+
+
+static int free_register(void) {
+  return 1 + random_below(REG_FREE - 1);
+}
+
+
+static int any_register(void) {
+  return random_below(32);
+}
+
+
+static sWord random_int(sWord low, sWord high) {
+  return low + (sWord) random_below(high - low + 1);
+}
+
+
+static Op pick(const Op *ops, int count) {
+  return ops[random_below(count)];
+}
+
+
+/* Encodes op with its operands and checks that it decodes back */
+static Word encode(Op op, int rd, int rs1, int rs2, sWord imm) {
+  Word bits = instruction_specs[op].match, u = imm;
+  Instruction instruction;
+  Decoded decoded;
+
+  bits |= rd << 7 | rs1 << 15 | rs2 << 20;
+  switch (instruction_specs[op].format) {
+    case FORMAT_I:
+    case FORMAT_LOAD:
+    case FORMAT_CSR:
+    case FORMAT_CSRI:
+      bits = (bits & 0x000FFFFF) | u << 20;
+      break;
+    case FORMAT_SHIFT:
+      bits = (bits & 0xFE0FFFFF) | (u & 31) << 20;
+      break;
+    case FORMAT_S:
+      bits = (bits & 0x01FFF07F) | (u & 0xFE0) << 20 | (u & 0x1F) << 7;
+      break;
+    case FORMAT_B:
+      bits = (bits & 0x01FFF07F) | (u & 0x1000) << 19 | (u & 0x7E0) << 20
+             | (u & 0x1E) << 7 | (u & 0x800) >> 4;
+      break;
+    case FORMAT_U:
+      bits = (bits & 0xFFF) | (u & 0xFFFFF000);
+      break;
+    case FORMAT_J:
+      bits = (bits & 0xFFF) | (u & 0x100000) << 11 | (u & 0x7FE) << 20
+             | (u & 0x800) << 9 | (u & 0xFF000);
+      break;
+    default:
+      break;
+  }
+
+  instruction.bits = bits;
+  decode(instruction, &decoded);
+  if (decoded.op != op) {
+    fprintf(stderr, "rvgen: %s encoded as %08x decodes as %s\n",
+            instruction_specs[op].name, bits, instruction_specs[decoded.op].name);
+    exit(-1);
+  }
+  return bits;
+}
+
+/* The same for a compressed instruction, given the fields of what it
+   expands to, as decode() fills them in */
+static Word encode_compressed(CompressedOp c, int rd, int rs1, int rs2, sWord imm) {
+  Word u = imm, h = 0, ci = (u & 0x20) << 7 | (u & 0x1F) << 2;
+  Word cj = (u & 0x800) << 1 | (u & 0x10) << 7 | (u & 0x300) << 1 | (u & 0x400) >> 2
+            | (u & 0x40) << 1 | (u & 0x80) >> 1 | (u & 0xE) << 2 | (u & 0x20) >> 3;
+  Word cb = (u & 0x100) << 4 | (u & 0x18) << 7 | (u & 0xC0) >> 1 | (u & 0x6) << 2 | (u & 0x20) >> 3;
+  Word cl = (u & 0x38) << 7 | (u & 0x4) << 4 | (u & 0x40) >> 1;
+  Instruction instruction;
+  Decoded decoded;
+  Format format;
+
+  switch (c) {
+    case COMPRESSED_c_addi4spn:
+      h = (u & 0x30) << 7 | (u & 0x3C0) << 1 | (u & 0x4) << 4 | (u & 0x8) << 2 | (rd - 8) << 2;
+      break;
+    case COMPRESSED_c_lw:
+      h = 0x4000 | cl | (rs1 - 8) << 7 | (rd - 8) << 2;
+      break;
+    case COMPRESSED_c_sw:
+      h = 0xC000 | cl | (rs1 - 8) << 7 | (rs2 - 8) << 2;
+      break;
+    case COMPRESSED_c_nop:
+      h = 0x0001;
+      break;
+    case COMPRESSED_c_addi:
+      h = 0x0001 | ci | rd << 7;
+      break;
+    case COMPRESSED_c_jal:
+      h = 0x2001 | cj;
+      break;
+    case COMPRESSED_c_li:
+      h = 0x4001 | ci | rd << 7;
+      break;
+    case COMPRESSED_c_addi16sp:
+      h = 0x6101 | (u & 0x200) << 3 | (u & 0x10) << 2 | (u & 0x40) >> 1 | (u & 0x180) >> 4 | (u & 0x20) >> 3;
+      break;
+    case COMPRESSED_c_lui:
+      u >>= 12;
+      h = 0x6001 | (u & 0x20) << 7 | (u & 0x1F) << 2 | rd << 7;
+      break;
+    case COMPRESSED_c_srli:
+    case COMPRESSED_c_srai:
+      h = 0x8001 | (c == COMPRESSED_c_srai) << 10 | (rd - 8) << 7 | (u & 0x1F) << 2;
+      break;
+    case COMPRESSED_c_andi:
+      h = 0x8801 | ci | (rd - 8) << 7;
+      break;
+    case COMPRESSED_c_sub:
+    case COMPRESSED_c_xor:
+    case COMPRESSED_c_or:
+    case COMPRESSED_c_and:
+      h = 0x8C01 | (c - COMPRESSED_c_sub) << 5 | (rd - 8) << 7 | (rs2 - 8) << 2;
+      break;
+    case COMPRESSED_c_j:
+      h = 0xA001 | cj;
+      break;
+    case COMPRESSED_c_beqz:
+    case COMPRESSED_c_bnez:
+      h = (c == COMPRESSED_c_beqz ? 0xC001 : 0xE001) | cb | (rs1 - 8) << 7;
+      break;
+    case COMPRESSED_c_slli:
+      h = 0x0002 | rd << 7 | (u & 0x1F) << 2;
+      break;
+    case COMPRESSED_c_lwsp:
+      h = 0x4002 | rd << 7 | (u & 0x20) << 7 | (u & 0x1C) << 2 | (u & 0xC0) >> 4;
+      break;
+    case COMPRESSED_c_jr:
+      h = 0x8002 | rs1 << 7;
+      break;
+    case COMPRESSED_c_mv:
+      h = 0x8002 | rd << 7 | rs2 << 2;
+      break;
+    case COMPRESSED_c_jalr:
+      h = 0x9002 | rs1 << 7;
+      break;
+    case COMPRESSED_c_add:
+      h = 0x9002 | rd << 7 | rs2 << 2;
+      break;
+    case COMPRESSED_c_swsp:
+      h = 0xC002 | rs2 << 2 | (u & 0x3C) << 7 | (u & 0xC0) << 1;
+      break;
+    default:
+      break;
+  }
+
+  instruction.bits = h;
+  decode(instruction, &decoded);
+  format = instruction_specs[decoded.op].format;
+  if (decoded.compressed != c || decoded.rd != rd || decoded.rs1 != rs1 || decoded.imm != imm ||
+      ((format == FORMAT_R || format == FORMAT_S || format == FORMAT_B) && decoded.rs2 != rs2)) {
+    fprintf(stderr, "rvgen: %s encoded as %04x decodes as %s x%d, x%d, x%d, %d\n", compressed_specs[c].name, h,
+            compressed_specs[decoded.compressed].name, decoded.rd, decoded.rs1, decoded.rs2, decoded.imm);
+    exit(-1);
+  }
+  return h;
+}
+
+
+static void emit(Word bits) {
+  if (length == capacity) {
+    capacity = capacity ? 2 * capacity : 4096;
+    code = realloc(code, capacity * sizeof(Word));
+  }
+  code[length++] = bits;
+}
+
+
+/* Loads a full 32-bit constant, as the li pseudo-instruction does */
+static void emit_li(int rd, Word value) {
+  sWord low = sign_extend(value & 0xFFF, 12);
+  emit(encode(OP_lui, rd, 0, 0, value - low));
+  emit(encode(OP_addi, rd, rd, 0, low));
+}
+
+
+/* One compressed instruction that falls through. The loads and stores
+   go through base, which holds DATA_BASE, and nothing writes it */
+static Word compressed_straight(int memory, int base) {
+  static const CompressedOp alu[] = { COMPRESSED_c_sub, COMPRESSED_c_xor, COMPRESSED_c_or, COMPRESSED_c_and };
+  int rd, rs2;
+
+  do rd = free_register(); while (rd == base);
+  do rs2 = 8 + random_below(8); while (rs2 == base);
+  if (memory && base == 2) {
+    if (random_below(2)) return encode_compressed(COMPRESSED_c_lwsp, rd, 2, 0, random_below(64) * 4);
+    return encode_compressed(COMPRESSED_c_swsp, 0, 2, any_register(), random_below(64) * 4);
+  }
+  if (memory) {
+    if (random_below(2)) return encode_compressed(COMPRESSED_c_lw, rs2, base, 0, random_below(32) * 4);
+    return encode_compressed(COMPRESSED_c_sw, 0, base, 8 + random_below(8), random_below(32) * 4);
+  }
+  switch (random_below(12)) {
+    case 0:
+      return encode_compressed(COMPRESSED_c_addi, rd, rd, 0, random_int(1, 31) * (random_below(2) ? 1 : -1));
+    case 1:
+      return encode_compressed(COMPRESSED_c_li, rd, 0, 0, random_int(-32, 31));
+    case 2:
+      do rd = free_register(); while (rd == 2 || rd == base);
+      return encode_compressed(COMPRESSED_c_lui, rd, 0, 0, sign_extend(random_int(1, 63), 6) << 12);
+    case 3:
+      return encode_compressed(random_below(2) ? COMPRESSED_c_srli : COMPRESSED_c_srai, rs2, rs2, 0, random_int(1, 31));
+    case 4:
+      return encode_compressed(COMPRESSED_c_andi, rs2, rs2, 0, random_int(-32, 31));
+    case 5:
+      return encode_compressed(alu[random_below(4)], rs2, rs2, 8 + random_below(8), 0);
+    case 6:
+      return encode_compressed(COMPRESSED_c_slli, rd, rd, 0, random_int(1, 31));
+    case 7:
+      return encode_compressed(COMPRESSED_c_mv, rd, 0, free_register(), 0);
+    case 8:
+      return encode_compressed(COMPRESSED_c_add, rd, rd, free_register(), 0);
+    case 9:
+      return base == 2 ? encode_compressed(COMPRESSED_c_nop, 0, 0, 0, 0)
+                       : encode_compressed(COMPRESSED_c_addi16sp, 2, 2, 0, random_int(1, 31) * (random_below(2) ? 16 : -16));
+    case 10:
+      return encode_compressed(COMPRESSED_c_addi4spn, rs2, 2, 0, random_int(1, 255) * 4);
+    default:
+      return encode_compressed(COMPRESSED_c_nop, 0, 0, 0, 0);
+  }
+}
+
+
+/* Two compressed instructions in a word, the first of which may load or
+   store: its base is set to DATA_BASE by the word before */
+static void emit_compressed_pair(void) {
+  int memory = random_below(3) == 0, base = random_below(2) ? 2 : 8 + random_below(8);
+  Word first;
+
+  if (memory) emit(encode(OP_addi, base, REG_DATA, 0, 0));
+  first = compressed_straight(memory, base);
+  emit(first | compressed_straight(0, memory ? base : 0) << 16);
+}
+
+
+/* One instruction, or a short sequence, that falls through to the next */
+static void emit_straight(Class class) {
+  static const Op alu_r[] = { OP_add, OP_sub, OP_sll, OP_slt, OP_xor, OP_srl, OP_sra, OP_or, OP_and };
+  static const Op alu_i[] = { OP_addi, OP_slti, OP_xori, OP_ori, OP_andi };
+  static const Op shifts[] = { OP_slli, OP_srli, OP_srai };
+  static const Op muls[] = { OP_mul, OP_mulh, OP_div, OP_rem };
+  static const Op loads[] = { OP_lb, OP_lh, OP_lw };
+  static const Op stores[] = { OP_sb, OP_sh, OP_sw };
+  static const Op amos[] = { OP_amoswap_w, OP_amoadd_w, OP_amoxor_w, OP_amoand_w, OP_amoor_w,
+                             OP_amomin_w, OP_amomax_w, OP_amominu_w, OP_amomaxu_w };
+  // no time: it would make runs differ
+  static const Word counters[] = { 0xC00, 0xC02, 0xC03, 0xC04, 0xC82, 0xF14 };
+  static const Op event_writes[] = { OP_csrrw, OP_csrrc, OP_csrrwi, OP_csrrsi, OP_csrrci };
+  Op op;
+  int size;
+
+  switch (class) {
+    case CLASS_alu:
+      switch (random_below(4)) {
+        case 0:
+          emit(encode(pick(alu_r, 9), free_register(), any_register(), any_register(), 0));
+          break;
+        case 1:
+          emit(encode(pick(alu_i, 5), free_register(), any_register(), 0, random_int(-2048, 2047)));
+          break;
+        case 2:
+          emit(encode(pick(shifts, 3), free_register(), any_register(), 0, random_below(32)));
+          break;
+        default:
+          op = random_below(2) ? OP_lui : OP_auipc;
+          emit(encode(op, free_register(), 0, 0, random_below(1 << 20) << 12));
+          break;
+      }
+      break;
+    case CLASS_mul:
+      emit(encode(pick(muls, 4), free_register(), any_register(), any_register(), 0));
+      break;
+    case CLASS_load:
+      op = pick(loads, 3);
+      size = 1 << (op - OP_lb);
+      emit(encode(op, free_register(), REG_DATA, 0, random_int(-2048 / size, 2047 / size) * size));
+      break;
+    case CLASS_store:
+      op = pick(stores, 3);
+      size = 1 << (op - OP_sb);
+      emit(encode(op, 0, REG_DATA, any_register(), random_int(-2048 / size, 2047 / size) * size));
+      break;
+    case CLASS_csr:
+      if (random_below(2)) {
+        emit(encode(OP_csrrs, free_register(), 0, 0, counters[random_below(6)]));
+      } else {
+        // pick what hpmcounter3 or 4 counts, any value being safe to write
+        op = pick(event_writes, 5);
+        size = op == OP_csrrwi || op == OP_csrrsi || op == OP_csrrci ? random_below(32) : any_register();
+        emit(encode(op, free_register(), size, 0, 0x323 + random_below(2)));
+      }
+      break;
+    case CLASS_compressed:
+      emit_compressed_pair();
+      break;
+    case CLASS_atomic:
+      emit(encode(OP_addi, REG_ATOMIC, REG_DATA, 0, random_int(-512, 511) * 4));
+      switch (random_below(3)) {
+        case 0:
+          emit(encode(OP_lr_w, free_register(), REG_ATOMIC, 0, 0));
+          emit(encode(OP_sc_w, free_register(), REG_ATOMIC, any_register(), 0));
+          break;
+        default:
+          emit(encode(pick(amos, 9), free_register(), REG_ATOMIC, any_register(), 0));
+          break;
+      }
+      break;
+    case CLASS_ecall:
+      // print_int of a random register
+      emit(encode(OP_addi, 11, any_register(), 0, 0));
+      emit(encode(OP_addi, 10, 0, 0, 1));
+      emit(encode(OP_ecall, 0, 0, 0, 0));
+      break;
+    default:
+      break;
+  }
+}
+
+
+static Class pick_class(int straight_only) {
+  int total = 0, i, r;
+  for (i = 0; i < CLASS_COUNT; i++) {
+    if (!straight_only || (i != CLASS_branch && i != CLASS_jump && i != CLASS_loop)) total += weights[i];
+  }
+  if (total == 0) return CLASS_alu;
+  r = random_below(total);
+  for (i = 0; i < CLASS_COUNT; i++) {
+    if (straight_only && (i == CLASS_branch || i == CLASS_jump || i == CLASS_loop)) continue;
+    if (r < weights[i]) return i;
+    r -= weights[i];
+  }
+  return CLASS_alu;
+}
+
+
+static void emit_skipped(int count) {
+  while (count--) emit_straight(pick_class(1));
+}
+
+
+static void emit_class(Class class) {
+  static const Op branches[] = { OP_beq, OP_bne };
+  Word start, trips, nop, skip = 1 + random_below(MAX_SKIP);
+  int rd;
+
+  switch (class) {
+    case CLASS_branch:
+      // forward over skip words, whichever way it goes
+      start = length;
+      emit(0);
+      emit_skipped(skip);
+      code[start] = encode(pick(branches, 2), 0, any_register(), any_register(), 4 * (length - start));
+      break;
+    case CLASS_jump:
+      rd = random_below(2) ? 0 : free_register();
+      if (random_below(2)) {
+        start = length;
+        emit(0);
+        emit_skipped(skip);
+        code[start] = encode(OP_jal, rd, 0, 0, 4 * (length - start));
+      } else {
+        emit(encode(OP_auipc, REG_JUMP, 0, 0, 0));
+        start = length;
+        emit(0);
+        emit_skipped(skip);
+        code[start] = encode(OP_jalr, rd, REG_JUMP, 0, 4 * (length - start + 1));
+      }
+      break;
+    case CLASS_compressed:
+      // a compressed branch or jump, in the first half, a fourth of the time
+      if (random_below(4)) {
+        emit_compressed_pair();
+        break;
+      }
+      nop = encode_compressed(COMPRESSED_c_nop, 0, 0, 0, 0) << 16;
+      switch (random_below(3)) {
+        case 0:
+          start = length;
+          emit(0);
+          emit_skipped(skip);
+          rd = random_below(2);
+          code[start] = encode_compressed(rd ? COMPRESSED_c_jal : COMPRESSED_c_j, rd, 0, 0, 4 * (length - start)) | nop;
+          break;
+        case 1:
+          start = length;
+          emit(0);
+          emit_skipped(skip);
+          rd = 8 + random_below(8);
+          code[start] = encode_compressed(random_below(2) ? COMPRESSED_c_beqz : COMPRESSED_c_bnez, 0, rd, 0,
+                                          4 * (length - start)) | nop;
+          break;
+        default:
+          // c.jr and c.jalr have no offset, so the target goes in REG_JUMP
+          emit(encode(OP_auipc, REG_JUMP, 0, 0, 0));
+          start = length;
+          emit(0);
+          emit(random_below(2) ? encode_compressed(COMPRESSED_c_jr, 0, REG_JUMP, 0, 0) | nop
+                               : encode_compressed(COMPRESSED_c_jalr, 1, REG_JUMP, 0, 0) | nop);
+          emit_skipped(skip);
+          code[start] = encode(OP_addi, REG_JUMP, REG_JUMP, 0, 4 * (length - start + 1));
+          break;
+      }
+      break;
+    case CLASS_loop:
+      trips = 1 + random_below(max_trips);
+      emit(encode(OP_addi, REG_LOOP, 0, 0, trips));
+      start = length;
+      emit_skipped(1 + random_below(MAX_BODY));
+      emit(encode(OP_addi, REG_LOOP, REG_LOOP, 0, -1));
+      emit(encode(OP_bne, 0, REG_LOOP, 0, -4 * (length - start)));
+      break;
+    default:
+      emit_straight(class);
+      break;
+  }
+}
+
+
+static void parse_mix(char *mix) {
+  char *item, *equals;
+  int i;
+  for (item = strtok(mix, ","); item; item = strtok(NULL, ",")) {
+    if ((equals = strchr(item, '=')) == NULL) goto bad;
+    *equals = '\0';
+    for (i = 0; i < CLASS_COUNT && strcmp(item, class_names[i]) != 0; i++);
+    if (i == CLASS_COUNT) goto bad;
+    weights[i] = atoi(equals + 1);
+  }
+  return;
+
+bad:
+  fprintf(stderr, "rvgen: bad mix item %s, classes are", item);
+  for (i = 0; i < CLASS_COUNT; i++) fprintf(stderr, " %s", class_names[i]);
+  fprintf(stderr, "\n");
+  exit(-1);
+}
+
+
+int main(int argc, char **argv) {
+  Word words = 10000, i;
+  FILE *out = stdout;
+  int c;
+
+  random_state = 1;
+  while ((c = getopt(argc, argv, "n:s:l:m:o:")) != -1) {
+    switch (c) {
+      case 'n':
+        words = strtoul(optarg, NULL, 0);
+        break;
+      case 's':
+        random_state = strtoull(optarg, NULL, 0) * 2 + 1;
+        break;
+      case 'l':
+        max_trips = strtoul(optarg, NULL, 0);
+        if (max_trips < 1 || max_trips > 2047) max_trips = 16;
+        break;
+      case 'm':
+        parse_mix(optarg);
+        break;
+      case 'o':
+        if ((out = fopen(optarg, "w")) == NULL) {
+          perror(optarg);
+          return -1;
+        }
+        break;
+      default:
+        fprintf(stderr, "usage: rvgen [-n words] [-s seed] [-l max trips] [-m class=weight,...] [-o file]\n");
+        return -1;
+    }
+  }
+  if (words > (DATA_BASE - 2048 - CODE_BASE) / 4 - 64) {
+    fprintf(stderr, "rvgen: at most %d words fit below the data\n", (DATA_BASE - 2048 - CODE_BASE) / 4 - 64);
+    return -1;
+  }
+
+  emit_li(REG_DATA, DATA_BASE);
+  while (length < words) emit_class(pick_class(0));
+  emit(encode(OP_addi, 10, 0, 0, 10));
+  emit(encode(OP_ecall, 0, 0, 0, 0));
+
+  for (i = 0; i < length; i++) fprintf(out, "%08x\n", code[i]);
+  if (out != stdout) fclose(out);
+  return 0;
+}
@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+/* Picks simulation points from the basic-block vectors of riscv -b, as
+   SimPoint does:
+
+     rvsimpoint [-k max clusters] [-s seed] -n interval file.bb
+
+   Each vector is scaled to sum to 1 and randomly projected down to
+   DIMENSIONS, then clustered with k-means for each k up to the maximum.
+   The smallest k that gets within 90% of the best spread the largest k
+   manages is taken. Each cluster is represented by the interval nearest
+   its centre, weighted by the share of intervals in the cluster. Writes
+   the points file riscv -P reads */
+
+#define DIMENSIONS 15
+#define ITERATIONS 100
+#define DEFAULT_MAX_K 10
+
+typedef double Vector[DIMENSIONS];
+
+static Vector *vectors;
+static int count;
+static unsigned long long random_state = 1;
+
+
+static double random_unit(void) {
+  // xorshift64*
+  random_state ^= random_state >> 12;
+  random_state ^= random_state << 25;
+  random_state ^= random_state >> 27;
+  return (double) ((random_state * 0x2545F4914F6CDD1DULL) >> 11) / (1ULL << 53);
+}
+
+
+/* The projection of block id onto dimension, uniform in [-1, 1), the
+   same every time it is asked for */
+static double projection(unsigned id, int dimension) {
+  unsigned long long h = (unsigned long long) id * 0x9E3779B97F4A7C15ULL ^ (unsigned long long) dimension * 0xC2B2AE3D27D4EB4FULL;
+  h ^= h >> 31;
+  h *= 0xBF58476D1CE4E5B9ULL;
+  h ^= h >> 29;
+  return (double) (h >> 11) / (1ULL << 52) - 1;
+}
+
+
+static void read_vectors(const char *filename) {
+  FILE *file = fopen(filename, "r");
+  char *line = NULL, *at;
+  size_t size = 0;
+  int capacity = 0, d, used;
+  unsigned id;
+  unsigned long long n;
+  double total;
+  Vector sum;
+
+  if (file == NULL) {
+    perror(filename);
+    exit(-1);
+  }
+  while (getline(&line, &size, file) > 0) {
+    if (line[0] != 'T') continue;
+    memset(sum, 0, sizeof(sum));
+    total = 0;
+    for (at = line + 1; sscanf(at, ":%u:%llu %n", &id, &n, &used) == 2; at += used) {
+      for (d = 0; d < DIMENSIONS; d++) sum[d] += n * projection(id, d);
+      total += n;
+    }
+    if (count == capacity) {
+      capacity = capacity ? 2 * capacity : 1024;
+      vectors = realloc(vectors, capacity * sizeof(Vector));
+    }
+    for (d = 0; d < DIMENSIONS; d++) vectors[count][d] = total ? sum[d] / total : 0;
+    count++;
+  }
+  free(line);
+  fclose(file);
+}
+
+
+static double distance(const double *a, const double *b) {
+  double sum = 0;
+  int d;
+  for (d = 0; d < DIMENSIONS; d++) sum += (a[d] - b[d]) * (a[d] - b[d]);
+  return sum;
+}
+
+
+/* Clusters into k with k-means++ seeding. Returns the sum of squared
+   distances to the centres */
+static double cluster(int k, Vector *centres, int *assignment) {
+  double *nearest = malloc(count * sizeof(double)), total, pick, spread = 0, d, best_distance;
+  int *sizes = malloc(k * sizeof(int)), c, i, j, iteration, best, moved = 1;
+
+  memcpy(centres[0], vectors[(int) (random_unit() * count)], sizeof(Vector));
+  for (c = 1; c < k; c++) {
+    total = 0;
+    for (i = 0; i < count; i++) {
+      nearest[i] = distance(vectors[i], centres[0]);
+      for (j = 1; j < c; j++) {
+        d = distance(vectors[i], centres[j]);
+        if (d < nearest[i]) nearest[i] = d;
+      }
+      total += nearest[i];
+    }
+    pick = random_unit() * total;
+    for (i = 0; i < count - 1 && (pick -= nearest[i]) > 0; i++);
+    memcpy(centres[c], vectors[i], sizeof(Vector));
+  }
+
+  for (i = 0; i < count; i++) assignment[i] = -1;
+  for (iteration = 0; iteration < ITERATIONS && moved; iteration++) {
+    moved = 0;
+    spread = 0;
+    for (i = 0; i < count; i++) {
+      best = 0;
+      best_distance = distance(vectors[i], centres[0]);
+      for (c = 1; c < k; c++) {
+        d = distance(vectors[i], centres[c]);
+        if (d < best_distance) {
+          best = c;
+          best_distance = d;
+        }
+      }
+      moved |= assignment[i] != best;
+      assignment[i] = best;
+      spread += best_distance;
+    }
+    memset(centres, 0, k * sizeof(Vector));
+    memset(sizes, 0, k * sizeof(int));
+    for (i = 0; i < count; i++) {
+      sizes[assignment[i]]++;
+      for (j = 0; j < DIMENSIONS; j++) centres[assignment[i]][j] += vectors[i][j];
+    }
+    for (c = 0; c < k; c++) {
+      for (j = 0; j < DIMENSIONS && sizes[c]; j++) centres[c][j] /= sizes[c];
+    }
+  }
+  free(nearest);
+  free(sizes);
+  return spread;
+}
+
+
+int main(int argc, char **argv) {
+  int max_k = DEFAULT_MAX_K, k, best_k, c, i, *assignment, *best_assignment, *representative, *sizes;
+  unsigned interval = 0;
+  double *spreads, d, *representative_distance;
+  Vector *centres;
+  int option;
+
+  while ((option = getopt(argc, argv, "k:s:n:")) != -1) {
+    switch (option) {
+      case 'k':
+        max_k = atoi(optarg);
+        break;
+      case 's':
+        random_state = strtoull(optarg, NULL, 0) * 2 + 1;
+        break;
+      case 'n':
+        interval = strtoul(optarg, NULL, 0);
+        break;
+      default:
+        goto usage;
+    }
+  }
+  if (argc <= optind || max_k < 1 || interval == 0) goto usage;
+
+  read_vectors(argv[optind]);
+  if (count == 0) {
+    fprintf(stderr, "rvsimpoint: no vectors in %s\n", argv[optind]);
+    return -1;
+  }
+  if (max_k > count) max_k = count;
+
+  centres = malloc(max_k * sizeof(Vector));
+  assignment = malloc(count * sizeof(int));
+  best_assignment = malloc(count * sizeof(int));
+  spreads = malloc((max_k + 1) * sizeof(double));
+  for (k = 1; k <= max_k; k++) spreads[k] = cluster(k, centres, assignment);
+
+  // the smallest k within 90% of the way from one cluster to max_k
+  for (best_k = 1; best_k < max_k && spreads[best_k] - spreads[max_k] > 0.1 * (spreads[1] - spreads[max_k]); best_k++);
+  cluster(best_k, centres, best_assignment);
+
+  representative = malloc(best_k * sizeof(int));
+  representative_distance = malloc(best_k * sizeof(double));
+  sizes = calloc(best_k, sizeof(int));
+  for (c = 0; c < best_k; c++) representative[c] = -1;
+  for (i = 0; i < count; i++) {
+    c = best_assignment[i];
+    sizes[c]++;
+    d = distance(vectors[i], centres[c]);
+    if (representative[c] < 0 || d < representative_distance[c]) {
+      representative[c] = i;
+      representative_distance[c] = d;
+    }
+  }
+
+  printf("interval %u\nintervals %d\n", interval, count);
+  for (c = 0; c < best_k; c++) {
+    if (sizes[c]) printf("point %d %f\n", representative[c], (double) sizes[c] / count);
+  }
+  return 0;
+
+usage:
+  fprintf(stderr, "usage: rvsimpoint [-k max clusters] [-s seed] -n interval file.bb\n");
+  return -1;
+}
@@ -0,0 +1,390 @@
+#define _GNU_SOURCE // for memmem()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "../types.h"
+#include "../utils.h"
+#include "../isa.h"
+#include "../riscv.h"
+#include "../replay.h"
+
+
+/* Compares two traces of riscv -r, or -t -r, and reports where they
+   first part:
+
+     rvtracediff [-p file.input] [-c context] expected.trace actual.trace
+
+   Both are mapped and compared 64 bytes at a time, so a long trace costs
+   about what reading it does, and nothing is held but the mappings.
+   Only once they differ are the records before the difference walked,
+   to count them and to find which instruction it was: from the -t line
+   if the trace has one, or else by following the program given with -p
+   alongside, taking branches the way the registers in the trace say
+   they went. The last context instructions are shown, then each
+   register the two disagree on.
+
+   Exits with 0 if the traces are the same, 1 if they differ, as cmp
+   does. riscv writes no binary trace, so text is all there is to read */
+
+#define BASE 0x1000
+#define DEFAULT_CONTEXT 4
+#define MAX_CONTEXT 64
+
+// "r%2d=%08x " four to a line, eight lines and a blank one
+#define FIELD 13
+#define LINE (4 * FIELD + 1)
+#define DUMP (8 * LINE + 1)
+
+typedef struct {
+  const char *name;
+  const char *text;
+  size_t size;
+} Trace;
+
+/* One instruction's share of a trace: whatever came before its register
+   dump, which is the -t line and the program's own output, then the dump.
+   Text after the last dump is a record without registers */
+typedef struct {
+  const char *start, *registers, *end;
+} Record;
+
+/* A record already walked, and the instruction it was for */
+typedef struct {
+  Record record;
+  Address pc;
+  int pc_known;
+} Step;
+
+static Byte memory[MEMORY_SPACE];
+static int have_program;
+
+
+/* csr.c comes in for the names of CSRs in the disassembly, and with it
+   csr_time(), which logs the clock for replay. Nothing runs here */
+int replay_input(Word *value) {
+  return 0;
+}
+
+
+void replay_record_input(Word value) {
+}
+
+
+static void map(Trace *trace, const char *name) {
+  struct stat st;
+  int fd = open(name, O_RDONLY);
+
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    perror(name);
+    exit(-1);
+  }
+  trace->name = name;
+  trace->size = st.st_size;
+  trace->text = "";
+  if (trace->size) {
+    trace->text = mmap(NULL, trace->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (trace->text == MAP_FAILED) {
+      perror(name);
+      exit(-1);
+    }
+    madvise((void *) trace->text, trace->size, MADV_SEQUENTIAL);
+  }
+  close(fd);
+}
+
+
+/* Loads a program as load_program() does */
+static void read_program(const char *filename) {
+  FILE *file = fopen(filename, "r");
+  char line[50];
+  Address at = BASE;
+  Word word;
+
+  if (file == NULL) {
+    perror(filename);
+    exit(-1);
+  }
+  while (fgets(line, sizeof(line), file) != NULL && at + 4 <= MEMORY_SPACE) {
+    word = (int32_t) strtol(line, NULL, 16);
+    memcpy(memory + at, &word, 4);
+    at += 4;
+  }
+  fclose(file);
+  have_program = 1;
+}
+
+
+/* The offset of the first byte where a and b differ, or size */
+static size_t first_difference(const char *a, const char *b, size_t size) {
+  size_t i = 0;
+#ifdef __SSE2__
+  __m128i same[4];
+  int mask, k;
+
+  for (; i + 64 <= size; i += 64) {
+    for (k = 0; k < 4; k++) {
+      same[k] = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (a + i + 16 * k)),
+                               _mm_loadu_si128((const __m128i *) (b + i + 16 * k)));
+    }
+    mask = _mm_movemask_epi8(_mm_and_si128(_mm_and_si128(same[0], same[1]), _mm_and_si128(same[2], same[3])));
+    if (mask != 0xFFFF) break;
+  }
+  // the difference is in these 64 bytes, or past the last whole 64
+  for (; i + 16 <= size; i += 16) {
+    mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (a + i)),
+                                            _mm_loadu_si128((const __m128i *) (b + i))));
+    if (mask != 0xFFFF) return i + __builtin_ctz(~mask);
+  }
+#else
+  unsigned long long x, y;
+
+  for (; i + 8 <= size; i += 8) {
+    memcpy(&x, a + i, 8);
+    memcpy(&y, b + i, 8);
+    if (x != y) break;
+  }
+#endif
+  for (; i < size && a[i] == b[i]; i++);
+  return i;
+}
+
+
+/* Reads the record starting at at. Returns 0 at the end of the trace */
+static int read_record(const Trace *trace, const char *at, Record *record) {
+  const char *end = trace->text + trace->size;
+
+  if (at >= end) return 0;
+  record->start = at;
+  record->registers = memmem(at, end - at, "r 0=", 4);
+  if (record->registers == NULL || end - record->registers < DUMP) {
+    record->registers = NULL;
+    record->end = end;
+  } else {
+    record->end = record->registers + DUMP;
+  }
+  return 1;
+}
+
+
+static Word hex(const char *text, int digits) {
+  Word value = 0;
+  int i, c;
+  for (i = 0; i < digits; i++) {
+    c = text[i];
+    value = value << 4 | (c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+  }
+  return value;
+}
+
+
+static Word register_value(const Record *record, int r) {
+  return hex(record->registers + r / 4 * LINE + r % 4 * FIELD + 4, 8);
+}
+
+
+/* The PC on the -t line the record starts with, if it has one */
+static int traced_pc(const Record *record, Address *pc) {
+  int i;
+  if (record->registers == NULL || record->registers - record->start < 10) return 0;
+  for (i = 0; i < 8; i++) {
+    if (!isxdigit((unsigned char) record->start[i])) return 0;
+  }
+  if (record->start[8] != ':') return 0;
+  *pc = hex(record->start, 8);
+  return 1;
+}
+
+
+static int instruction_at(Address pc, Instruction *instruction) {
+  instruction->bits = 0;
+  if (pc < BASE || pc + 4 > MEMORY_SPACE || (pc & 1)) return 0;
+  memcpy(&instruction->bits, memory + pc, 4);
+  if (is_compressed(instruction->bits)) instruction->bits &= 0xFFFF;
+  return 1;
+}
+
+
+/* Where the program goes after the instruction at pc, given the record
+   before it, or NULL for the state riscv starts in. Returns 0 where that
+   cannot be known from here */
+static int next_pc(Address pc, const Record *before, Address *next) {
+  Word R[32] = { 0 };
+  Instruction instruction;
+  Decoded d;
+  int r;
+
+  if (!instruction_at(pc, &instruction)) return 0;
+  decode(instruction, &d);
+  if (before) {
+    for (r = 1; r < 32; r++) R[r] = register_value(before, r);
+  } else {
+    // as hart_reset() leaves hart 0
+    R[2] = 0xEFFFF;
+    R[3] = 0x3000;
+  }
+  switch (d.op) {
+    case OP_invalid:
+      return 0;
+    case OP_jal:
+      *next = pc + d.imm;
+      break;
+    case OP_jalr:
+      *next = (R[d.rs1] + d.imm) & ~1;
+      break;
+    case OP_beq:
+      *next = R[d.rs1] == R[d.rs2] ? pc + d.imm : pc + d.length;
+      break;
+    case OP_bne:
+      *next = R[d.rs1] != R[d.rs2] ? pc + d.imm : pc + d.length;
+      break;
+    default:
+      *next = pc + d.length;
+  }
+  return 1;
+}
+
+
+/* Steps through trace up to the record holding offset, which it leaves
+   in steps[*last], and the context before it in the ring. Returns the
+   number of register dumps before that record */
+static Double walk(const Trace *trace, size_t offset, Step *steps, int ring, int *last) {
+  const char *at = trace->text, *difference = trace->text + offset;
+  Record before;
+  Double count = 0;
+  Address pc = BASE;
+  int pc_known = have_program, i = 0;
+  Step *step;
+
+  while (1) {
+    step = &steps[i];
+    if (!read_record(trace, at, &step->record)) {
+      // the other trace goes on past this one
+      step->record.start = step->record.end = at;
+      step->record.registers = NULL;
+      step->pc_known = 0;
+      break;
+    }
+    if (traced_pc(&step->record, &pc)) pc_known = 1;
+    step->pc = pc;
+    step->pc_known = pc_known && step->record.registers;
+    if (step->record.end > difference || step->record.registers == NULL) break;
+
+    if (pc_known) pc_known = next_pc(pc, count ? &before : NULL, &pc);
+    before = step->record;
+    at = step->record.end;
+    count++;
+    i = (i + 1) % ring;
+  }
+  *last = i;
+  return count;
+}
+
+
+/* Prints the line of text around at, up to the end of the trace */
+static void print_line(const char *label, const Trace *trace, const char *at) {
+  const char *start = at, *end = trace->text + trace->size, *stop;
+
+  while (start > trace->text && start[-1] != '\n') start--;
+  if (start == end) {
+    printf("  %-9s end of trace\n", label);
+    return;
+  }
+  stop = memchr(start, '\n', end - start);
+  printf("  %-9s %.*s\n", label, (int) ((stop ? stop : end) - start), start);
+}
+
+
+static void print_step(const Step *step, int current) {
+  char line[DISASM_MAX_LINE];
+  const char *stop;
+  Instruction instruction;
+  Address pc;
+
+  if (traced_pc(&step->record, &pc)) {
+    stop = memchr(step->record.start, '\n', step->record.registers - step->record.start);
+    printf("%s %.*s\n", current ? "=>" : "  ", (int) (stop - step->record.start), step->record.start);
+  } else if (step->pc_known && instruction_at(step->pc, &instruction)) {
+    printf("%s %08x: ", current ? "=>" : "  ", step->pc);
+    fwrite(line, 1, disassemble(line, instruction) - line, stdout);
+  }
+}
+
+
+static void report(const Trace *expected, const Trace *actual, size_t offset, int context) {
+  Step steps[MAX_CONTEXT + 1], *step;
+  Record other;
+  Double count;
+  Address pc;
+  int last, i, r, ring = context + 1;
+  size_t prefix;
+
+  count = walk(expected, offset, steps, ring, &last);
+  step = &steps[last];
+  printf("%s and %s differ at instruction %llu, byte %zu\n",
+         expected->name, actual->name, (unsigned long long) count + 1, offset);
+
+  if (context) {
+    for (i = count < (Double) context ? context - count : 0; i <= context; i++) {
+      print_step(&steps[(last + ring - context + i) % ring], i == context);
+    }
+    if (!have_program && !traced_pc(&step->record, &pc)) {
+      printf("   (with -p and the program, the instructions would show here)\n");
+    }
+  }
+
+  // the same text before the dump, and both dumps whole: name the registers
+  prefix = step->record.registers ? step->record.registers - step->record.start : 0;
+  if (step->record.registers && read_record(actual, actual->text + (step->record.start - expected->text), &other) &&
+      other.registers && other.registers - other.start == prefix && memcmp(other.start, step->record.start, prefix) == 0) {
+    for (r = 0; r < 32; r++) {
+      if (register_value(&step->record, r) != register_value(&other, r)) {
+        printf("  x%-2d expected %08x, actual %08x\n", r, register_value(&step->record, r), register_value(&other, r));
+      }
+    }
+    return;
+  }
+  print_line("expected:", expected, expected->text + offset);
+  print_line("actual:", actual, actual->text + offset);
+}
+
+
+int main(int argc, char **argv) {
+  Trace expected, actual;
+  size_t size, offset;
+  int option, context = DEFAULT_CONTEXT;
+
+  while ((option = getopt(argc, argv, "p:c:")) != -1) {
+    switch (option) {
+      case 'p':
+        read_program(optarg);
+        break;
+      case 'c':
+        context = atoi(optarg);
+        break;
+      default:
+        goto usage;
+    }
+  }
+  if (argc - optind != 2 || context < 0 || context > MAX_CONTEXT) goto usage;
+
+  map(&expected, argv[optind]);
+  map(&actual, argv[optind + 1]);
+  size = expected.size < actual.size ? expected.size : actual.size;
+  offset = first_difference(expected.text, actual.text, size);
+  if (offset == size && expected.size == actual.size) return 0;
+
+  report(&expected, &actual, offset, context);
+  return 1;
+
+usage:
+  fprintf(stderr, "usage: rvtracediff [-p file.input] [-c context] expected.trace actual.trace\n");
+  return -1;
+}
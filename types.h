@@ -23,12 +23,44 @@ typedef Word Address; /* unsigned, 32-bit */
 /* A register value */
 typedef Word Register; /* unsigned 32-bit*/
 
+/* Events the hardware performance counters can count, see csr.c */
+typedef enum {
+  EVENT_NONE,
+  EVENT_LOAD,
+  EVENT_STORE,
+  EVENT_TAKEN_BRANCH,
+  EVENT_MULDIV,
+  EVENT_COUNT,
+} Event;
+
+/* Counter numbers as in the CSR addresses: 0 cycle, 1 time, 2 instret,
+   3-31 programmable */
+#define COUNTER_COUNT 32
+
+/* Only instret and the event totals are kept up to date while running.
+   Every counter reads as its base count plus an offset that absorbs
+   writes, and a programmable counter's base is the total of the event
+   it is set to count */
+typedef struct {
+  Double instret;
+  Double events[EVENT_COUNT];
+  Byte event[COUNTER_COUNT];
+  Double offset[COUNTER_COUNT];
+} Counters;
+
 /* The processor data:
   32 registers
-  PC program counter */
+  PC program counter
+  hartid which hart this is, see hart.c
+  reservation/reserved_value the LR/SC reservation, see part2.c
+  counters the performance counters */
 typedef struct {
   Register R[32];
   Register PC;
+  Word hartid;
+  Address reservation;
+  Word reserved_value;
+  Counters counters;
 } Processor;
 
 /* Possible lengths of data, and their lengths in bytes.
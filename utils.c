@@ -1,6 +1,13 @@
 #include "utils.h"
+#include "console.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 
 
 //sign extends a bitfield with given size
@@ -39,7 +46,7 @@ int get_jump_distance(Instruction instruction) {
   int bit11 = ((instruction.jtype.imm >> 8) & 0x1) << 11;
   int bit19_al_12 = (instruction.jtype.imm & 0xFF) << 12;
   int imm = bit20 | bit10_al_1 | bit11 | bit19_al_12;
-  return bitExtender(imm, 20);
+  return bitExtender(imm, 21);
 }
 
 /* Offset in BYTES */
@@ -58,18 +65,98 @@ int get_memory_offset(Instruction instruction) {
 }
 
 
+/* Hand-rolled formatters for the disassembler and console, which print too
+   much to afford printf. Each writes at out, without a terminator, and
+   returns a pointer past the last character written */
+
+char *format_str(char *out, const char *str) {
+  while (*str) *out++ = *str++;
+  return out;
+}
+
+
+char *format_reg(char *out, unsigned int reg) {
+  *out++ = 'x';
+  if (reg >= 10) *out++ = '0' + reg / 10;
+  *out++ = '0' + reg % 10;
+  return out;
+}
+
+
+char *format_int(char *out, int value) {
+  char digits[10];
+  unsigned int magnitude = value;
+  int n = 0;
+
+  if (value < 0) {
+    *out++ = '-';
+    magnitude = -magnitude;
+  }
+  do {
+    digits[n++] = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude);
+  while (n) *out++ = digits[--n];
+  return out;
+}
+
+
+/* Lower-case hex, zero-padded to width digits */
+char *format_hex(char *out, unsigned int value, int width) {
+  static const char hex[] = "0123456789abcdef";
+  int i;
+  for (i = width - 1; i >= 0; i--) {
+    out[i] = hex[value & 0xF];
+    value >>= 4;
+  }
+  return out + width;
+}
+
+
+/* Everything that stops the guest ends up here, so a front end such as
+   the gdb stub can learn the exit status before the process goes */
+void (*halt_hook)(int status);
+
+void halt_simulation(int status) {
+  if (halt_hook) halt_hook(status);
+  exit(status);
+}
+
+
 void handle_invalid_instruction(Instruction instruction) {
-  printf("Invalid Instruction: 0x%08x\n", instruction.bits);
+  console_report("Invalid Instruction: 0x%08x\n", instruction.bits);
 }
 
 
 void handle_invalid_read(Address address) {
-  printf("Bad Read. Address: 0x%08x\n", address);
-  exit(-1);
+  console_report("Bad Read. Address: 0x%08x\n", address);
+  halt_simulation(-1);
 }
 
 
 void handle_invalid_write(Address address) {
-  printf("Bad Write. Address: 0x%08x\n", address);
-  exit(-1);
-}
\ No newline at end of file
+  console_report("Bad Write. Address: 0x%08x\n", address);
+  halt_simulation(-1);
+}
+
+
+/* A Unix socket at path, listening. A socket left behind by an earlier
+   run is replaced. Returns -1, with errno set, if it cannot be made */
+int listen_unix(const char *path, int backlog) {
+  struct sockaddr_un address = { .sun_family = AF_UNIX };
+  struct stat st;
+  int server;
+
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(address.sun_path, path);
+  if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+  if ((server = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) return -1;
+  if (bind(server, (struct sockaddr *) &address, sizeof(address)) < 0 || listen(server, backlog) < 0) {
+    close(server);
+    return -1;
+  }
+  return server;
+}
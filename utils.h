@@ -3,6 +3,8 @@
 
 #include "types.h"
 
+/* Disassembly layouts. part1.c produces these with the format_* helpers
+   below rather than printf, but the output is the same */
 #define RTYPE_FORMAT "%s\tx%d, x%d, x%d\n"
 #define ITYPE_FORMAT "%s\tx%d, x%d, %d\n"
 #define JALR_FORMAT "jalr\tx%d, x%d, %d\n"
@@ -13,12 +15,54 @@
 #define BRANCH_FORMAT "%s\tx%d, x%d, %d\n"
 #define ECALL_FORMAT "ecall\n"
 
+/* Longest line disassemble() can produce, with room for an address prefix */
+#define DISASM_MAX_LINE 64
+
+/* Branchless immediate decoders, one per instruction format. Each takes
+   the whole instruction word and sign-extends with an arithmetic shift of
+   the sign bit, which stays at bit 31 of the word until the final shift.
+   get_branch_distance() and friends below are the readable reference
+   versions; tests/imm_test.c checks these against them exhaustively */
+
+static inline sWord sign_extend(Word field, unsigned int size) {
+  return (sWord) (field << (32 - size)) >> (32 - size);
+}
+
+static inline sWord imm_i(Word bits) {
+  return (sWord) bits >> 20;
+}
+
+static inline sWord imm_s(Word bits) {
+  return ((sWord) (bits & 0xFE000000) >> 20) | ((bits >> 7) & 0x1F);
+}
+
+static inline sWord imm_b(Word bits) {
+  return ((sWord) (bits & 0x80000000) >> 19) | ((bits << 4) & 0x800)
+         | ((bits >> 20) & 0x7E0) | ((bits >> 7) & 0x1E);
+}
+
+static inline sWord imm_u(Word bits) {
+  return bits & 0xFFFFF000;
+}
+
+static inline sWord imm_j(Word bits) {
+  return ((sWord) (bits & 0x80000000) >> 11) | (bits & 0xFF000)
+         | ((bits >> 9) & 0x800) | ((bits >> 20) & 0x7FE);
+}
+
 int bitExtender(unsigned, unsigned);
 int get_branch_distance(Instruction);
 int get_jump_distance(Instruction);
 int get_memory_offset(Instruction);
+char *format_str(char *, const char *);
+char *format_reg(char *, unsigned int);
+char *format_int(char *, int);
+char *format_hex(char *, unsigned int, int);
+extern void (*halt_hook)(int);
+void halt_simulation(int);
 void handle_invalid_instruction(Instruction);
 void handle_invalid_read(Address);
 void handle_invalid_write(Address);
+int listen_unix(const char *, int);
 
 #endif